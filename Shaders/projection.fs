@@ -1,11 +1,15 @@
 #version 330 core
 
 in vec3 colour;
+in vec3 texCoord;
+
+uniform sampler2DArray blockTextures;
 
 out vec4 FragColor;
 
 void main()
 {
-    FragColor = vec4(1.0);
-    FragColor = vec4(colour, 1.0);
-}
\ No newline at end of file
+    vec4 texel = texture(blockTextures, texCoord);
+    if (texel.a < 0.5) { discard; }
+    FragColor = vec4(texel.rgb * colour, 1.0);
+}
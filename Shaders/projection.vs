@@ -1,14 +1,30 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in uint aData;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 out vec3 colour;
+out vec3 texCoord;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
-    colour = vec3(1.0, 1.0, 1.0) * (aPos.y / 32);
-}
\ No newline at end of file
+    vec4 worldPos = model * vec4(aPos, 1.0f);
+    gl_Position = projection * view * worldPos;
+
+    // Light baked in by the mesher, skylight in bits 4-7, block light in bits 0-3
+    // and ambient occlusion in bits 8-9
+    float skyLight = float((aData >> 4u) & 15u) / 15.0;
+    float blockLight = float(aData & 15u) / 15.0;
+    float ao = float((aData >> 8u) & 3u) / 3.0;
+    float light = max(max(skyLight, blockLight), 0.05) * (0.4 + 0.6 * ao);
+    colour = vec3(1.0, 1.0, 1.0) * light;
+
+    // Texture layer in bits 10-17, face direction in bits 18-20. Coordinates come
+    // from the world position across the face so textures repeat once per block.
+    uint axis = ((aData >> 18u) & 7u) % 3u;
+    vec2 uv = axis == 0u ? worldPos.zy : (axis == 1u ? worldPos.xz : worldPos.xy);
+    texCoord = vec3(uv, float((aData >> 10u) & 255u));
+}
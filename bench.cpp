@@ -0,0 +1,703 @@
+// Chunk generation and meshing benchmark. Built without GL by "make bench",
+// prints JSON so results can be compared between commits:
+//
+//     ./Bench.exe [--repetitions n] [--out results.json]
+//
+// Also times each chunk wire encoding against the raw voxel array, see
+// chunkcodec.h. Build with ZSTD=1 or LZ4=1 to include the compressed ones.
+// Counts the triangles of every level of detail with real neighbours and the
+// triangles a frame skips by face direction, counts the fragments drawing
+// front to back saves over grid order, and times World::Raycast over a fixed
+// patch of terrain.
+
+#include "world.h"
+#include "chunk.h"
+#include "drawqueue.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include "chunkcodec.h"
+#include "rle.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// Every heap allocation made while a stage runs is counted. Every form of
+// global new and delete is replaced, plain, sized and aligned, so none of
+// them pairs the library's allocator with this one. They are kept out of
+// line, otherwise GCC sees free called on a pointer from new once they are
+// inlined and warns about mismatched new and delete.
+std::atomic<size_t> allocationCount{0};
+std::atomic<size_t> allocationBytes{0};
+
+__attribute__((noinline)) void* countedAlloc(size_t size, size_t alignment){
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) { size = 1; }
+    void* p = alignment <= alignof(std::max_align_t) ? std::malloc(size) : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (p == nullptr) { throw std::bad_alloc(); }
+    return p;
+}
+
+__attribute__((noinline)) void countedFree(void* p) noexcept { std::free(p); }
+
+void* operator new(size_t size) { return countedAlloc(size, 0); }
+void* operator new[](size_t size) { return countedAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return countedAlloc(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return countedAlloc(size, (size_t)alignment); }
+
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+
+// Same chunk size as World
+const int chunkXSize = 16, chunkYSize = 32, chunkZSize = 16;
+const int voxelsPerChunk = chunkXSize * chunkYSize * chunkZSize;
+
+struct TerrainCase{
+    const char* name;
+    float noiseScale;
+    int octaves;
+};
+
+// Nearly level ground, the game's own settings, and steep high frequency hills
+const TerrainCase terrainCases[] = {
+    { "flat",        0.002f, 1 },
+    { "default",     0.025f, 4 },
+    { "mountainous", 0.09f,  6 },
+};
+
+const siv::PerlinNoise::seed_type seeds[] = { 0, 1337, 90210 };
+
+const int coordinates[][2] = {
+    { 0, 0 }, { 1, 0 }, { -3, 7 }, { 12, -5 }, { 40, 40 }, { -25, -60 }, { 100, 3 }, { -7, -7 }
+};
+
+struct StageResult{
+    std::string terrain;
+    std::string stage;
+    double nsPerChunk;
+    double trianglesPerChunk;
+    double allocationsPerChunk;
+    double bytesAllocatedPerChunk;
+};
+
+// Runs one stage over every chunk, repetitions times, and keeps the median
+// time. Allocations are taken from the last repetition, once scratch buffers
+// have grown to size. Triangles are only counted for meshing stages.
+template <typename Stage>
+StageResult measure(const char* terrain, const char* stage, bool meshes, std::vector<Chunk*>& chunks, int repetitions, Stage run){
+    std::vector<double> times(repetitions);
+    size_t allocations = 0, bytes = 0;
+    for (int r = 0; r < repetitions; r++){
+        size_t startCount = allocationCount, startBytes = allocationBytes;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < chunks.size(); i++) { run(chunks[i]); }
+        times[r] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        allocations = allocationCount - startCount;
+        bytes = allocationBytes - startBytes;
+    }
+    std::sort(times.begin(), times.end());
+
+    double triangles = 0.0;
+    for (size_t i = 0; meshes && i < chunks.size(); i++) { triangles += chunks[i]->TriangleCount(); }
+
+    double count = (double)chunks.size();
+    return StageResult{ terrain, stage, times[times.size() / 2] / count, triangles / count, allocations / count, bytes / count };
+}
+
+struct WireResult{
+    std::string terrain;
+    std::string encoding;
+    double encodeNsPerChunk;
+    double decodeNsPerChunk;
+    double bytesPerChunk;
+};
+
+// Encodes then decodes every chunk's blocks, repetitions times, keeping the
+// median of each. Every decode is checked against the original.
+template <typename Encode, typename Decode>
+WireResult measureWire(const char* terrain, const char* encoding, const std::vector< std::vector<unsigned int> >& chunks,
+                       int repetitions, Encode encode, Decode decode){
+    std::vector< std::vector<unsigned char> > encoded(chunks.size());
+    std::vector<unsigned int> decoded(voxelsPerChunk);
+    std::vector<double> encodeTimes(repetitions), decodeTimes(repetitions);
+    bool roundTrips = true;
+    for (int r = 0; r < repetitions; r++){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < chunks.size(); i++){
+            encoded[i].clear();
+            encode(chunks[i].data(), encoded[i]);
+        }
+        encodeTimes[r] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        double decodeTime = 0.0;
+        for (size_t i = 0; i < chunks.size(); i++){
+            start = std::chrono::steady_clock::now();
+            bool ok = decode(encoded[i].data(), encoded[i].size(), decoded.data());
+            decodeTime += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            roundTrips = roundTrips && ok && decoded == chunks[i];
+        }
+        decodeTimes[r] = decodeTime;
+    }
+    if (!roundTrips) { std::cout << "ERROR::BENCH::ROUND_TRIP " << terrain << " " << encoding << std::endl; }
+    std::sort(encodeTimes.begin(), encodeTimes.end());
+    std::sort(decodeTimes.begin(), decodeTimes.end());
+
+    double bytes = 0.0;
+    for (size_t i = 0; i < encoded.size(); i++) { bytes += encoded[i].size(); }
+    double count = (double)chunks.size();
+    return WireResult{ terrain, encoding, encodeTimes[repetitions / 2] / count, decodeTimes[repetitions / 2] / count, bytes / count };
+}
+
+// The raw array, the region store's RLE and every encoding this build has
+void measureEncodings(const char* terrain, const std::vector< std::vector<unsigned int> >& chunks, int repetitions, std::vector<WireResult>& results){
+    results.push_back(measureWire(terrain, "rle", chunks, repetitions,
+        [](const unsigned int* data, std::vector<unsigned char>& out){ RLE::Encode(data, voxelsPerChunk, out); },
+        [](const unsigned char* in, size_t size, unsigned int* data){ return RLE::Decode(in, size, data, voxelsPerChunk); }));
+    for (uint32_t encoding = 0; encoding < ChunkEncoding::Count; encoding++){
+        if ((ChunkCodec::Supported() & (1u << encoding)) == 0) { continue; }
+        results.push_back(measureWire(terrain, chunkEncodingNames[encoding], chunks, repetitions,
+            [encoding](const unsigned int* data, std::vector<unsigned char>& out){ ChunkCodec::Encode(data, voxelsPerChunk, encoding, out); },
+            [encoding](const unsigned char* in, size_t size, unsigned int* data){ return ChunkCodec::Decode(in, size, encoding, data, voxelsPerChunk); }));
+    }
+}
+
+// One tick's edits as a DeltaBatch, against sending the edited chunks again
+struct DeltaResult{
+    int edits;
+    int chunks;
+    size_t batchBytes;
+    double packedChunkBytes;
+    double encodeNs;
+};
+
+// Triangles at each level of a chunk meshed with its real neighbours in the
+// apron, as World meshes them, so the skirts along the sides are counted
+struct LodResult{
+    std::string terrain;
+    double trianglesPerChunk[Chunk::maxLod + 1];
+};
+
+LodResult measureLodTriangles(const TerrainCase& terrain){
+    LodResult result = { terrain.name, {} };
+    MeshScratch& scratch = MeshScratch::ForThread();
+    size_t meshed = 0;
+    for (const int* coord : coordinates){
+        Chunk* patch[3][3];
+        for (int dz = -1; dz <= 1; dz++){
+            for (int dx = -1; dx <= 1; dx++){
+                Chunk* ch = new Chunk(coord[0] + dx, coord[1] + dz, chunkXSize, chunkYSize, chunkZSize);
+                ch->noisescale = terrain.noiseScale;
+                ch->octaves = terrain.octaves;
+                ch->seed = seeds[1];
+                ch->GenerateInternalData();
+                ch->GenerateLightData();
+                patch[dz + 1][dx + 1] = ch;
+            }
+        }
+
+        Chunk* centre = patch[1][1];
+        scratch.apron.resize(centre->ApronSize());
+        centre->FillApron(scratch.apron.data());
+        for (int dz = -1; dz <= 1; dz++){
+            for (int dx = -1; dx <= 1; dx++){
+                if (dx != 0 || dz != 0) { centre->CopyApronFrom(patch[dz + 1][dx + 1], dx, dz, scratch.apron.data()); }
+            }
+        }
+        for (int level = 0; level <= Chunk::maxLod; level++){
+            centre->mesher.Mesh(scratch, scratch.apron.data(), centre->AllSections(), level);
+            result.trianglesPerChunk[level] += scratch.indices.size() / 3;
+        }
+        meshed++;
+
+        for (int i = 0; i < 9; i++) { delete patch[i / 3][i % 3]; }
+    }
+    for (int level = 0; level <= Chunk::maxLod; level++){
+        result.trianglesPerChunk[level] /= meshed;
+        if (level > 0 && result.trianglesPerChunk[level] >= result.trianglesPerChunk[level - 1]){
+            std::cout << "ERROR::BENCH::LOD_NOT_SMALLER " << terrain.name << " level " << level << std::endl;
+        }
+    }
+    return result;
+}
+
+// Triangles in the sections inside the view frustum, and how many of them
+// ChunkGpu::Draw sends after skipping the face directions that point away
+// from the camera across a whole section (ChunkMesher::FacingDirections),
+// with the draw calls that takes
+struct DirectionResult{
+    std::string view;
+    size_t sections;
+    size_t frustumTriangles;
+    size_t drawnTriangles;
+    size_t drawCalls;
+};
+
+DirectionResult countFacingTriangles(World& world, const char* view, glm::vec3 eye, glm::vec3 forward){
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f) *
+                               glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+    DirectionResult result = { view, 0, 0, 0, 0 };
+    std::map< std::pair<int, int>, Chunk* >::iterator it;
+    for (it = world.chunkMap.begin(); it != world.chunkMap.end(); it++){
+        Chunk* ch = it->second;
+        const MeshData& mesh = ch->GetMesh();
+        glm::vec3 corner = glm::vec3(ch->xCoord * chunkXSize, 0, ch->zCoord * chunkZSize);
+        for (int s = 0; s < mesh.sectionCount; s++){
+            glm::vec3 min = corner + glm::vec3(0, s * Chunk::sectionSize, 0);
+            glm::vec3 max = corner + glm::vec3(chunkXSize, std::min((s + 1) * Chunk::sectionSize, chunkYSize), chunkZSize);
+            if (mesh.sections[s].indexCount == 0 || !OcclusionCuller::BoxInFrustum(viewProjection, min, max)) { continue; }
+
+            // Same grouping as ChunkGpu::Draw
+            unsigned int directions = ch->mesher.FacingDirections(eye - corner, s);
+            const unsigned int* counts = mesh.sections[s].directionIndexCount;
+            result.sections++;
+            for (int d = 0; d < 6; ){
+                result.frustumTriangles += counts[d] / 3;
+                if ((directions & (1u << d)) == 0) { d++; continue; }
+                unsigned int count = counts[d];
+                for (d++; d < 6 && (directions & (1u << d)); d++) { count += counts[d]; result.frustumTriangles += counts[d] / 3; }
+                result.drawnTriangles += count / 3;
+                if (count > 0) { result.drawCalls++; }
+            }
+        }
+    }
+    return result;
+}
+
+// Fragments that pass the depth test when the frustum sections of a view are
+// drawn in grid order, the order the renderer walked chunks in before
+// DrawQueue, and front to back through DrawQueue. Rasterized on the CPU into a
+// small depth buffer with back faces culled and GL_LESS, as the game sets up
+// GL. covered is the pixels the terrain ends up on, the fewest fragments any
+// order can get away with.
+struct OverdrawResult{
+    std::string view;
+    size_t triangles;
+    size_t covered;
+    size_t gridFragments;
+    size_t sortedFragments;
+};
+
+class DepthRaster{
+    public:
+        static const int width = 320, height = 240;
+        size_t passed = 0;
+
+        void Clear(){
+            depth.assign(width * height, 1.0f);
+            passed = 0;
+        }
+
+        size_t Covered(){
+            size_t covered = 0;
+            for (float d : depth) { covered += d < 1.0f; }
+            return covered;
+        }
+
+        void Triangle(const glm::mat4& mvp, glm::vec3 a, glm::vec3 b, glm::vec3 c){
+            glm::vec4 in[3] = { mvp * glm::vec4(a, 1.0f), mvp * glm::vec4(b, 1.0f), mvp * glm::vec4(c, 1.0f) };
+
+            // Only the near plane is clipped, the viewport bounds take care of the sides
+            glm::vec4 clipped[4];
+            int n = 0;
+            for (int i = 0; i < 3; i++){
+                glm::vec4 p = in[i], q = in[(i + 1) % 3];
+                float dp = p.z + p.w, dq = q.z + q.w;
+                if (dp >= 0.0f) { clipped[n++] = p; }
+                if ((dp >= 0.0f) != (dq >= 0.0f)) { clipped[n++] = p + (q - p) * (dp / (dp - dq)); }
+            }
+
+            glm::vec3 screen[4];
+            for (int i = 0; i < n; i++){
+                glm::vec3 ndc = glm::vec3(clipped[i]) / clipped[i].w;
+                screen[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+            }
+            for (int i = 1; i + 1 < n; i++) { Rasterize(screen[0], screen[i], screen[i + 1]); }
+        }
+
+    private:
+        std::vector<float> depth;
+
+        static float Edge(glm::vec3 a, glm::vec3 b, float x, float y){ return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x); }
+
+        // Counter clockwise is the front, as in GL
+        void Rasterize(glm::vec3 a, glm::vec3 b, glm::vec3 c){
+            float area = Edge(a, b, c.x, c.y);
+            if (area <= 0.0f) { return; }
+
+            int minX = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+            int maxX = std::min(width - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+            int minY = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+            int maxY = std::min(height - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+            for (int y = minY; y <= maxY; y++){
+                for (int x = minX; x <= maxX; x++){
+                    float px = x + 0.5f, py = y + 0.5f;
+                    float w0 = Edge(b, c, px, py), w1 = Edge(c, a, px, py), w2 = Edge(a, b, px, py);
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) { continue; }
+
+                    float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+                    float& stored = depth[y * width + x];
+                    if (z < stored){
+                        stored = z;
+                        passed++;
+                    }
+                }
+            }
+        }
+};
+
+// Sections of a chunk whose mesh is not empty and lies in the view frustum
+unsigned int frustumSections(Chunk* ch, const glm::mat4& viewProjection){
+    const MeshData& mesh = ch->GetMesh();
+    glm::vec3 corner = glm::vec3(ch->xCoord * chunkXSize, 0, ch->zCoord * chunkZSize);
+    unsigned int sections = 0;
+    for (int s = 0; s < mesh.sectionCount; s++){
+        glm::vec3 min = corner + glm::vec3(0, s * Chunk::sectionSize, 0);
+        glm::vec3 max = corner + glm::vec3(chunkXSize, std::min((s + 1) * Chunk::sectionSize, chunkYSize), chunkZSize);
+        if (mesh.sections[s].indexCount > 0 && OcclusionCuller::BoxInFrustum(viewProjection, min, max)) { sections |= 1u << s; }
+    }
+    return sections;
+}
+
+// Submits the chosen sections of a chunk, returns the triangles sent
+size_t rasterizeChunk(DepthRaster& raster, const glm::mat4& viewProjection, Chunk* ch, unsigned int sections){
+    const MeshData& mesh = ch->GetMesh();
+    glm::mat4 mvp = glm::translate(viewProjection, glm::vec3(ch->xCoord * chunkXSize, 0, ch->zCoord * chunkZSize));
+    size_t triangles = 0;
+    for (int s = 0; s < mesh.sectionCount; s++){
+        if ((sections & (1u << s)) == 0) { continue; }
+        const MeshRange& range = mesh.sections[s];
+        const Vertex* vertices = mesh.vertices + range.vertexStart;
+        const unsigned int* indices = mesh.indices + range.indexStart;
+        for (unsigned int i = 0; i + 2 < range.indexCount; i += 3){
+            raster.Triangle(mvp, vertices[indices[i]].position, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position);
+        }
+        triangles += range.indexCount / 3;
+    }
+    return triangles;
+}
+
+OverdrawResult countOverdraw(World& world, const char* view, glm::vec3 eye, glm::vec3 forward){
+    // The game's projection, see Camera
+    glm::mat4 viewProjection = glm::perspective(glm::radians(90.0f), (float)DepthRaster::width / DepthRaster::height, 0.1f, 1000.0f) *
+                               glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+    OverdrawResult result = { view, 0, 0, 0, 0 };
+    DepthRaster raster;
+    DrawQueue queue;
+    queue.maxDistance = (world.renderDistance + 2) * std::sqrt((float)(chunkXSize * chunkXSize + chunkYSize * chunkYSize + chunkZSize * chunkZSize));
+
+    raster.Clear();
+    for (int z = -world.renderDistance; z <= world.renderDistance; z++){
+        for (int x = -world.renderDistance; x <= world.renderDistance; x++){
+            Chunk* ch = world.FindChunk(x, z);
+            unsigned int sections = ch != nullptr ? frustumSections(ch, viewProjection) : 0;
+            if (sections == 0) { continue; }
+            result.triangles += rasterizeChunk(raster, viewProjection, ch, sections);
+
+            // Distance to the nearest point of the chunk, as WorldRenderer::DistanceToChunk
+            glm::vec3 min = glm::vec3(x * chunkXSize, 0, z * chunkZSize);
+            glm::vec3 max = min + glm::vec3(chunkXSize, chunkYSize, chunkZSize);
+            queue.Add(ch, sections, glm::length(glm::clamp(eye, min, max) - eye));
+        }
+    }
+    result.gridFragments = raster.passed;
+    result.covered = raster.Covered();
+
+    raster.Clear();
+    queue.SortFrontToBack();
+    for (size_t i = 0; i < queue.entries.size(); i++) { rasterizeChunk(raster, viewProjection, queue.entries[i].chunk, queue.entries[i].sections); }
+    result.sortedFragments = raster.passed;
+    if (raster.Covered() != result.covered) { std::cout << "ERROR::BENCH::OVERDRAW_COVERAGE " << view << std::endl; }
+    return result;
+}
+
+struct RaycastResult{
+    std::string set;
+    float range;
+    size_t rays;
+    double castsPerSecond;
+    double hitFraction;
+};
+
+// Random rays from eye height above the ground in the middle of a 5x5 patch
+// of generated chunks. The generator is seeded per set, so every run casts
+// the same rays.
+RaycastResult measureRaycasts(World& world, const char* set, float range, size_t rays, unsigned int state, int repetitions){
+    std::vector<glm::vec3> origins(rays), directions(rays);
+    for (size_t i = 0; i < rays; i++){
+        float r[5];
+        for (float& value : r){
+            state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+            value = (state & 0xffffff) / (float)0x1000000;
+        }
+        origins[i] = glm::vec3(-chunkXSize + r[0] * 3 * chunkXSize, chunkYSize - 0.5f, -chunkZSize + r[2] * 3 * chunkZSize);
+        RaycastHit ground = world.Raycast(origins[i], glm::vec3(0.0f, -1.0f, 0.0f), chunkYSize);
+        if (ground.hit) { origins[i].y = std::min(chunkYSize - 0.5f, ground.block.y + 1.0f + r[1] * 2.0f); }
+        float y = r[3] * 2.0f - 1.0f, angle = r[4] * 6.2831853f, flat = std::sqrt(1.0f - y * y);
+        directions[i] = glm::vec3(flat * std::cos(angle), y, flat * std::sin(angle));
+    }
+
+    std::vector<double> times(repetitions);
+    size_t hits = 0;
+    for (int rep = 0; rep < repetitions; rep++){
+        hits = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rays; i++) { hits += world.Raycast(origins[i], directions[i], range).hit ? 1 : 0; }
+        times[rep] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::sort(times.begin(), times.end());
+    return RaycastResult{ set, range, rays, rays / times[repetitions / 2], hits / (double)rays };
+}
+
+std::string toJson(const std::vector<StageResult>& results, const std::vector<WireResult>& wire, const DeltaResult& delta,
+                   const std::vector<LodResult>& lods, const std::vector<DirectionResult>& facing, const std::vector<OverdrawResult>& overdraw,
+                   const std::vector<RaycastResult>& raycasts, int repetitions, size_t chunksPerCase){
+    std::string out = "{\n";
+    out += "  \"chunk_size\": [" + std::to_string(chunkXSize) + ", " + std::to_string(chunkYSize) + ", " + std::to_string(chunkZSize) + "],\n";
+    out += "  \"chunks_per_case\": " + std::to_string(chunksPerCase) + ",\n";
+    out += "  \"repetitions\": " + std::to_string(repetitions) + ",\n";
+    out += "  \"compiler\": \"" + std::string(__VERSION__) + "\",\n";
+    out += "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++){
+        const StageResult& r = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+            "    { \"terrain\": \"%s\", \"stage\": \"%s\", \"ns_per_voxel\": %.3f, \"ns_per_chunk\": %.0f, "
+            "\"triangles_per_chunk\": %.1f, \"allocations_per_chunk\": %.2f, \"bytes_allocated_per_chunk\": %.0f }%s\n",
+            r.terrain.c_str(), r.stage.c_str(), r.nsPerChunk / voxelsPerChunk, r.nsPerChunk,
+            r.trianglesPerChunk, r.allocationsPerChunk, r.bytesAllocatedPerChunk, i + 1 < results.size() ? "," : "");
+        out += line;
+    }
+    out += "  ],\n";
+
+    out += "  \"raw_bytes_per_chunk\": " + std::to_string(voxelsPerChunk * sizeof(unsigned int)) + ",\n";
+    out += "  \"wire\": [\n";
+    for (size_t i = 0; i < wire.size(); i++){
+        const WireResult& w = wire[i];
+        double rawBytes = voxelsPerChunk * sizeof(unsigned int);
+        char line[512];
+        std::snprintf(line, sizeof(line),
+            "    { \"terrain\": \"%s\", \"encoding\": \"%s\", \"bytes_per_chunk\": %.0f, \"ratio_to_raw\": %.4f, "
+            "\"encode_ns_per_chunk\": %.0f, \"decode_ns_per_chunk\": %.0f, \"encode_mb_s\": %.0f, \"decode_mb_s\": %.0f }%s\n",
+            w.terrain.c_str(), w.encoding.c_str(), w.bytesPerChunk, w.bytesPerChunk / rawBytes,
+            w.encodeNsPerChunk, w.decodeNsPerChunk, rawBytes / w.encodeNsPerChunk * 1e9 / (1024.0 * 1024.0),
+            rawBytes / w.decodeNsPerChunk * 1e9 / (1024.0 * 1024.0), i + 1 < wire.size() ? "," : "");
+        out += line;
+    }
+    out += "  ],\n";
+
+    char line[256];
+    std::snprintf(line, sizeof(line),
+        "  \"delta_batch\": { \"edits\": %d, \"chunks\": %d, \"bytes\": %zu, \"packed_chunks_bytes\": %.0f, \"encode_ns\": %.0f }\n",
+        delta.edits, delta.chunks, delta.batchBytes, delta.packedChunkBytes, delta.encodeNs);
+    out += line;
+    out.insert(out.size() - 1, ",");
+
+    out += "  \"lod_triangles\": [\n";
+    for (size_t i = 0; i < lods.size(); i++){
+        const LodResult& l = lods[i];
+        std::string levels, ratios;
+        for (int level = 0; level <= Chunk::maxLod; level++){
+            std::snprintf(line, sizeof(line), "%s%.1f", level > 0 ? ", " : "", l.trianglesPerChunk[level]);
+            levels += line;
+            std::snprintf(line, sizeof(line), "%s%.3f", level > 0 ? ", " : "", l.trianglesPerChunk[level] / l.trianglesPerChunk[0]);
+            ratios += line;
+        }
+        out += "    { \"terrain\": \"" + l.terrain + "\", \"triangles_per_chunk\": [" + levels + "], \"ratio_to_lod0\": [" + ratios + "] }" +
+               (i + 1 < lods.size() ? "," : "") + "\n";
+    }
+    out += "  ],\n";
+
+    out += "  \"facing_directions\": [\n";
+    for (size_t i = 0; i < facing.size(); i++){
+        const DirectionResult& f = facing[i];
+        std::snprintf(line, sizeof(line),
+            "    { \"view\": \"%s\", \"sections\": %zu, \"frustum_triangles\": %zu, \"drawn_triangles\": %zu, "
+            "\"culled_fraction\": %.3f, \"draw_calls\": %zu }%s\n",
+            f.view.c_str(), f.sections, f.frustumTriangles, f.drawnTriangles,
+            1.0 - f.drawnTriangles / (double)std::max<size_t>(1, f.frustumTriangles), f.drawCalls, i + 1 < facing.size() ? "," : "");
+        out += line;
+    }
+    out += "  ],\n";
+
+    out += "  \"overdraw\": [\n";
+    for (size_t i = 0; i < overdraw.size(); i++){
+        const OverdrawResult& o = overdraw[i];
+        std::snprintf(line, sizeof(line),
+            "    { \"view\": \"%s\", \"triangles\": %zu, \"covered_pixels\": %zu, \"grid_order_fragments\": %zu, "
+            "\"front_to_back_fragments\": %zu, \"fragments_saved\": %.3f }%s\n",
+            o.view.c_str(), o.triangles, o.covered, o.gridFragments, o.sortedFragments,
+            1.0 - o.sortedFragments / (double)std::max<size_t>(1, o.gridFragments), i + 1 < overdraw.size() ? "," : "");
+        out += line;
+    }
+    out += "  ],\n";
+
+    out += "  \"raycast\": [\n";
+    for (size_t i = 0; i < raycasts.size(); i++){
+        const RaycastResult& r = raycasts[i];
+        std::snprintf(line, sizeof(line),
+            "    { \"set\": \"%s\", \"range\": %.0f, \"rays\": %zu, \"casts_per_second\": %.0f, \"hit_fraction\": %.3f }%s\n",
+            r.set.c_str(), r.range, r.rays, r.castsPerSecond, r.hitFraction, i + 1 < raycasts.size() ? "," : "");
+        out += line;
+    }
+    out += "  ]\n";
+    return out + "}\n";
+}
+
+int main(int argc, char** argv){
+    int repetitions = 5;
+    const char* outPath = nullptr;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) { repetitions = std::max(1, std::atoi(argv[++i])); }
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) { outPath = argv[++i]; }
+    }
+
+    std::vector<StageResult> results;
+    std::vector<WireResult> wire;
+    DeltaResult delta = {};
+    std::vector<LodResult> lods;
+    size_t chunksPerCase = 0;
+    for (const TerrainCase& terrain : terrainCases){
+        std::vector<Chunk*> chunks;
+        for (siv::PerlinNoise::seed_type seed : seeds){
+            for (const int* coord : coordinates){
+                Chunk* ch = new Chunk(coord[0], coord[1], chunkXSize, chunkYSize, chunkZSize);
+                ch->noisescale = terrain.noiseScale;
+                ch->octaves = terrain.octaves;
+                ch->seed = seed;
+                chunks.push_back(ch);
+            }
+        }
+        chunksPerCase = chunks.size();
+
+        // Warm up, allocates the voxel and light buffers and grows the mesh scratch
+        for (Chunk* ch : chunks){
+            ch->GenerateInternalData();
+            ch->GenerateLightData();
+            ch->GenerateMeshData();
+        }
+
+        results.push_back(measure(terrain.name, "generate", false, chunks, repetitions, [](Chunk* ch){ ch->GenerateInternalData(); }));
+        results.push_back(measure(terrain.name, "light", false, chunks, repetitions, [](Chunk* ch){ ch->GenerateLightData(); }));
+        for (int level = 0; level <= 2; level++){
+            std::string stage = level == 0 ? "mesh" : "mesh_lod" + std::to_string(level);
+            for (Chunk* ch : chunks) { ch->targetLod = level; }
+            results.push_back(measure(terrain.name, stage.c_str(), true, chunks, repetitions, [](Chunk* ch){ ch->GenerateMeshData(); }));
+        }
+
+        // Full detail again without the corner occlusion lookups, the difference
+        // to "mesh" is what ambient occlusion costs
+        for (Chunk* ch : chunks) { ch->targetLod = 0; ch->mesher.ambientOcclusion = false; }
+        results.push_back(measure(terrain.name, "mesh_no_ao", true, chunks, repetitions, [](Chunk* ch){ ch->GenerateMeshData(); }));
+        for (Chunk* ch : chunks) { ch->mesher.ambientOcclusion = true; }
+
+        lods.push_back(measureLodTriangles(terrain));
+
+        std::vector< std::vector<unsigned int> > blocks;
+        for (Chunk* ch : chunks) { blocks.push_back(std::vector<unsigned int>(ch->BlockData(), ch->BlockData() + voxelsPerChunk)); }
+        measureEncodings(terrain.name, blocks, repetitions, wire);
+
+        // A player digging: 16 blocks in each of 4 chunks, next to each other
+        if (std::strcmp(terrain.name, "default") == 0){
+            DeltaBatch batch;
+            std::vector<unsigned char> body, packed;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int c = 0; c < 4; c++){
+                for (int e = 0; e < 16; e++) { batch.Add(chunks[c]->xCoord, chunks[c]->zCoord, chunks[c]->BlockIndex(glm::ivec3(e, 20 - e / 4, 8)), 0); }
+            }
+            batch.Encode(body);
+            delta.encodeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            for (int c = 0; c < 4; c++) { ChunkCodec::Encode(chunks[c]->BlockData(), voxelsPerChunk, ChunkEncoding::Packed, packed); }
+            delta = DeltaResult{ (int)batch.Edits(), 4, body.size(), (double)packed.size(), delta.encodeNs };
+        }
+
+        for (Chunk* ch : chunks) { delete ch; }
+    }
+
+    // Sixteen block types at random, the worst case for run length coding
+    std::vector< std::vector<unsigned int> > scattered(chunksPerCase, std::vector<unsigned int>(voxelsPerChunk));
+    unsigned int state = 2463534242u;
+    for (std::vector<unsigned int>& chunk : scattered){
+        for (unsigned int& block : chunk){
+            state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+            block = state % 16;
+        }
+    }
+    measureEncodings("scattered", scattered, repetitions, wire);
+
+    // Player reach as used for breaking blocks, and a longer look across the patch
+    std::vector<RaycastResult> raycasts;
+    {
+        World world(2);
+        for (int z = -2; z <= 2; z++){
+            for (int x = -2; x <= 2; x++){
+                Chunk* ch = new Chunk(x, z, chunkXSize, chunkYSize, chunkZSize);
+                ch->seed = 1337;
+                ch->GenerateBlocks();
+                ch->chunkState = 2;
+                world.chunkMap[std::pair<int, int>(x, z)] = ch;
+            }
+        }
+        raycasts.push_back(measureRaycasts(world, "reach", 8.0f, 100000, 2463534242u, repetitions));
+        raycasts.push_back(measureRaycasts(world, "long", 48.0f, 100000, 88675123u, repetitions));
+    }
+
+    // A camera at eye height in the middle of a render distance 6 patch of
+    // the default terrain, meshed the way World meshes generated chunks
+    std::vector<DirectionResult> facing;
+    std::vector<OverdrawResult> overdraw;
+    {
+        World world(6);
+        for (int z = -world.renderDistance; z <= world.renderDistance; z++){
+            for (int x = -world.renderDistance; x <= world.renderDistance; x++){
+                Chunk* ch = new Chunk(x, z, chunkXSize, chunkYSize, chunkZSize);
+                ch->seed = 1337;
+                ch->GenerateBlocks();
+                ch->GenerateLightData();
+                ch->targetLod = world.LodFor(std::max(std::abs(x), std::abs(z)));
+                ch->chunkState = 2;
+                world.chunkMap[std::pair<int, int>(x, z)] = ch;
+            }
+        }
+        std::map< std::pair<int, int>, Chunk* >::iterator it;
+        for (it = world.chunkMap.begin(); it != world.chunkMap.end(); it++) { it->second->MeshGenerated(world.BuildApron(it->second)); }
+
+        glm::vec3 eye = glm::vec3(chunkXSize / 2 + 0.5f, chunkYSize - 0.5f, chunkZSize / 2 + 0.5f);
+        RaycastHit ground = world.Raycast(eye, glm::vec3(0.0f, -1.0f, 0.0f), chunkYSize);
+        if (ground.hit) { eye.y = std::min(chunkYSize - 0.5f, ground.block.y + 2.6f); }
+
+        facing.push_back(countFacingTriangles(world, "north", eye, glm::vec3(0.0f, 0.0f, -1.0f)));
+        facing.push_back(countFacingTriangles(world, "east", eye, glm::vec3(1.0f, 0.0f, 0.0f)));
+        facing.push_back(countFacingTriangles(world, "south", eye, glm::vec3(0.0f, 0.0f, 1.0f)));
+        facing.push_back(countFacingTriangles(world, "west", eye, glm::vec3(-1.0f, 0.0f, 0.0f)));
+        facing.push_back(countFacingTriangles(world, "down", eye, glm::normalize(glm::vec3(0.0f, -1.0f, -1.0f))));
+
+        overdraw.push_back(countOverdraw(world, "north", eye, glm::vec3(0.0f, 0.0f, -1.0f)));
+        overdraw.push_back(countOverdraw(world, "east", eye, glm::vec3(1.0f, 0.0f, 0.0f)));
+        overdraw.push_back(countOverdraw(world, "south", eye, glm::vec3(0.0f, 0.0f, 1.0f)));
+        overdraw.push_back(countOverdraw(world, "west", eye, glm::vec3(-1.0f, 0.0f, 0.0f)));
+        overdraw.push_back(countOverdraw(world, "down", eye, glm::normalize(glm::vec3(0.0f, -1.0f, -1.0f))));
+    }
+
+    std::string json = toJson(results, wire, delta, lods, facing, overdraw, raycasts, repetitions, chunksPerCase);
+    std::cout << json;
+    if (outPath != nullptr){
+        std::ofstream file(outPath);
+        if (!file) { std::cout << "ERROR::BENCH::FILE_NOT_OPENED " << outPath << std::endl; return 1; }
+        file << json;
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#ifndef BLOCKREGISTRY_H
+#define BLOCKREGISTRY_H
+
+// Block ids stored in chunk voxel data
+namespace Blocks {
+    enum : unsigned int {
+        Air = 0,
+        Stone = 1,
+        Dirt = 2,
+        Grass = 3,
+        Glass = 4,
+        Lamp = 5,
+    };
+}
+
+// Layers of the block texture array
+namespace TextureLayers {
+    enum : unsigned char {
+        Stone,
+        Dirt,
+        GrassTop,
+        GrassSide,
+        Glass,
+        Lamp,
+        Count
+    };
+}
+
+// File names of the texture layers, see TextureArray
+constexpr const char* textureLayerNames[TextureLayers::Count] = {
+    "stone", "dirt", "grass_top", "grass_side", "glass", "lamp"
+};
+
+// opaque   - hides the faces of blocks next to it and stops light
+// solid    - stops the player and raycasts
+// emission - block light given off, 0-15
+// ticks    - gets random ticks, see RandomTicker
+// layers   - texture layer per face in the mesher's order: +X, +Y, +Z, -X, -Y, -Z
+struct BlockDef{
+    unsigned int id;
+    const char* name;
+    bool opaque;
+    bool solid;
+    unsigned char emission;
+    bool ticks;
+    unsigned char layers[6];
+};
+
+// Built in blocks, registered at compile time
+constexpr BlockDef builtInBlocks[] = {
+    { Blocks::Air,   "air",   false, false, 0,  false, { 0, 0, 0, 0, 0, 0 } },
+    { Blocks::Stone, "stone", true,  true,  0,  false, { TextureLayers::Stone, TextureLayers::Stone, TextureLayers::Stone,
+                                                         TextureLayers::Stone, TextureLayers::Stone, TextureLayers::Stone } },
+    { Blocks::Dirt,  "dirt",  true,  true,  0,  false, { TextureLayers::Dirt, TextureLayers::Dirt, TextureLayers::Dirt,
+                                                         TextureLayers::Dirt, TextureLayers::Dirt, TextureLayers::Dirt } },
+    { Blocks::Grass, "grass", true,  true,  0,  true,  { TextureLayers::GrassSide, TextureLayers::GrassTop, TextureLayers::GrassSide,
+                                                         TextureLayers::GrassSide, TextureLayers::Dirt, TextureLayers::GrassSide } },
+    { Blocks::Glass, "glass", false, true,  0,  false, { TextureLayers::Glass, TextureLayers::Glass, TextureLayers::Glass,
+                                                         TextureLayers::Glass, TextureLayers::Glass, TextureLayers::Glass } },
+    { Blocks::Lamp,  "lamp",  true,  true,  14, false, { TextureLayers::Lamp, TextureLayers::Lamp, TextureLayers::Lamp,
+                                                         TextureLayers::Lamp, TextureLayers::Lamp, TextureLayers::Lamp } },
+};
+
+// Properties laid out as one flat array per property, indexed by block id
+struct BlockTables{
+    static const unsigned int maxBlocks = 256;
+
+    unsigned char opaque[maxBlocks];
+    unsigned char solid[maxBlocks];
+    unsigned char emission[maxBlocks];
+    unsigned char ticks[maxBlocks];
+    unsigned char layer[6][maxBlocks];
+    bool valid;
+};
+
+constexpr BlockTables BuildBlockTables(){
+    BlockTables t{};
+    t.valid = true;
+    unsigned char registered[BlockTables::maxBlocks] = {};
+    for (const BlockDef& def : builtInBlocks){
+        if (def.id >= BlockTables::maxBlocks || registered[def.id] || def.emission > 15) { t.valid = false; continue; }
+        registered[def.id] = 1;
+        t.opaque[def.id] = def.opaque;
+        t.solid[def.id] = def.solid;
+        t.emission[def.id] = def.emission;
+        t.ticks[def.id] = def.ticks;
+        for (int f = 0; f < 6; f++) { t.layer[f][def.id] = def.layers[f]; }
+    }
+    return t;
+}
+
+// Branch free property lookups for the mesher, lighting, collision and random ticks. Ids are
+// masked into the table, so anything outside it reads as some other block
+// rather than out of bounds memory.
+class BlockRegistry{
+    public:
+        static const unsigned int maxBlocks = BlockTables::maxBlocks;
+        static constexpr BlockTables tables = BuildBlockTables();
+        static_assert(tables.valid, "Built in blocks must have unique ids below maxBlocks and emission up to 15");
+
+        static bool Opaque(unsigned int id){ return tables.opaque[id & (maxBlocks - 1)]; }
+        static bool Solid(unsigned int id){ return tables.solid[id & (maxBlocks - 1)]; }
+        static unsigned char Emission(unsigned int id){ return tables.emission[id & (maxBlocks - 1)]; }
+        static bool Ticks(unsigned int id){ return tables.ticks[id & (maxBlocks - 1)]; }
+        static unsigned char Layer(unsigned int id, int face){ return tables.layer[face][id & (maxBlocks - 1)]; }
+};
+
+#endif
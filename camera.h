@@ -10,6 +10,8 @@
 class Camera{
     public:
         glm::vec3 position;
+        // Position at the start of the current tick, rendering blends towards position
+        glm::vec3 previousPosition;
         glm::vec3 forward;
         glm::vec3 up;
         
@@ -25,11 +27,22 @@ class Camera{
 
         Camera(glm::vec3 position, glm::vec3 forward, glm::vec3 up, float fov){
             this->position = position;
+            this->previousPosition = position;
             this->forward = forward;
             this->up = up;
             this->fov = fov;
         }
 
+        // Call before moving the camera in a simulation tick
+        void BeginTick(){
+            previousPosition = position;
+        }
+
+        // Position between the last two ticks, alpha is the fraction of a tick since the last one
+        glm::vec3 InterpolatedPosition(float alpha){
+            return glm::mix(previousPosition, position, alpha);
+        }
+
         glm::mat4 GetPerspectiveMatrix(int screenWidth, int screenHeight){
             return glm::perspective(glm::radians(fov), (float)screenWidth / (float)screenHeight, nearClip, farClip);
         }
@@ -0,0 +1,134 @@
+// Correctness checks for the GL free parts of the game. Built and run by
+// "make check", prints every failed check and exits non-zero if any failed:
+//
+//     ./Checks.exe
+
+#include "lighting.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <iostream>
+
+const int chunkXSize = 16, chunkYSize = 32, chunkZSize = 16;
+
+int failures = 0;
+
+void expect(bool condition, const std::string& what){
+    if (!condition){
+        std::cout << "ERROR::CHECK::" << what << std::endl;
+        failures++;
+    }
+}
+
+// Generated and lit chunks from -1 to 1 on both axes, on nearly level ground
+// about halfway up, with a light engine hooked up the way World does it
+class LightFixture{
+    public:
+        LightEngine engine;
+
+        LightFixture() : engine(chunkXSize, chunkYSize, chunkZSize){
+            for (int z = -1; z <= 1; z++){
+                for (int x = -1; x <= 1; x++){
+                    Chunk* ch = new Chunk(x, z, chunkXSize, chunkYSize, chunkZSize);
+                    ch->noisescale = 0.002f;
+                    ch->octaves = 1;
+                    ch->GenerateBlocks();
+                    ch->GenerateLightData();
+                    ch->chunkState = 2;
+                    chunks[std::pair<int, int>(x, z)] = ch;
+                }
+            }
+            engine.findChunk = [this](int x, int z){
+                std::map< std::pair<int, int>, Chunk* >::iterator it = chunks.find(std::pair<int, int>(x, z));
+                return it != chunks.end() ? it->second : nullptr;
+            };
+            engine.onChanged = [](Chunk*, glm::ivec3){};
+        }
+
+        ~LightFixture(){
+            std::map< std::pair<int, int>, Chunk* >::iterator it;
+            for (it = chunks.begin(); it != chunks.end(); it++) { delete it->second; }
+        }
+
+        // Same steps as World::ChangeBlock
+        void SetBlock(glm::ivec3 pos, unsigned int block){
+            glm::ivec3 local;
+            Chunk* ch = Locate(pos, local);
+            unsigned int old = ch->GetAt(local.x, local.y, local.z);
+            ch->SetAt(local.x, local.y, local.z, block);
+            engine.OnBlockChanged(pos, old, block);
+        }
+
+        unsigned char BlockLight(glm::ivec3 pos){
+            glm::ivec3 local;
+            Chunk* ch = Locate(pos, local);
+            return ch->GetBlockLight(local.x, local.y, local.z);
+        }
+
+        // Highest block light anywhere in the fixture
+        unsigned char MaxBlockLight(){
+            unsigned char highest = 0;
+            std::map< std::pair<int, int>, Chunk* >::iterator it;
+            for (it = chunks.begin(); it != chunks.end(); it++){
+                for (int y = 0; y < chunkYSize; y++){
+                    for (int z = 0; z < chunkZSize; z++){
+                        for (int x = 0; x < chunkXSize; x++) { highest = std::max(highest, it->second->GetBlockLight(x, y, z)); }
+                    }
+                }
+            }
+            return highest;
+        }
+
+    private:
+        std::map< std::pair<int, int>, Chunk* > chunks;
+
+        Chunk* Locate(glm::ivec3 pos, glm::ivec3& local){
+            int x = pos.x >= 0 ? pos.x / chunkXSize : (pos.x - chunkXSize + 1) / chunkXSize;
+            int z = pos.z >= 0 ? pos.z / chunkZSize : (pos.z - chunkZSize + 1) / chunkZSize;
+            local = glm::ivec3(pos.x - x * chunkXSize, pos.y, pos.z - z * chunkZSize);
+            return chunks[std::pair<int, int>(x, z)];
+        }
+};
+
+// A lamp lights its cell and spreads across the chunk border, breaking it
+// leaves no light behind
+void checkLampPlacedAndBroken(){
+    LightFixture world;
+    glm::ivec3 lamp = glm::ivec3(1, 26, 8);
+    unsigned char emission = BlockRegistry::Emission(Blocks::Lamp);
+
+    world.SetBlock(lamp, Blocks::Lamp);
+    expect(world.BlockLight(lamp) == emission, "LAMP_NOT_LIT");
+    expect(world.BlockLight(lamp + glm::ivec3(-2, 0, 0)) == emission - 2, "LAMP_LIGHT_NOT_ACROSS_BORDER");
+
+    world.SetBlock(lamp, Blocks::Air);
+    expect(world.MaxBlockLight() == 0, "LAMP_LIGHT_LEFT_AFTER_BREAK");
+}
+
+// Every block the registry gives an emission leaves no light behind when it
+// is replaced, whether by an open, a see-through or an opaque block
+void checkEmittersRemoved(){
+    const unsigned int replacements[] = { Blocks::Air, Blocks::Glass, Blocks::Stone };
+    for (const BlockDef& def : builtInBlocks){
+        if (def.emission == 0) { continue; }
+        for (unsigned int replacement : replacements){
+            LightFixture world;
+            glm::ivec3 pos = glm::ivec3(-3, 26, 5);
+            world.SetBlock(pos, def.id);
+            expect(world.BlockLight(pos) == def.emission, std::string("EMITTER_NOT_LIT ") + def.name);
+            world.SetBlock(pos, replacement);
+            expect(world.MaxBlockLight() == BlockRegistry::Emission(replacement),
+                   std::string("EMITTER_LIGHT_LEFT ") + def.name + " replaced by " + builtInBlocks[replacement].name);
+        }
+    }
+}
+
+int main(){
+    checkLampPlacedAndBroken();
+    checkEmittersRemoved();
+
+    if (failures > 0) { std::cout << failures << " checks failed" << std::endl; return 1; }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
@@ -2,263 +2,480 @@
 #define CHUNK_H
 
 #include <vector>
-#include <map>
-#include <iostream>
-#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+#include <cstddef>
 
 #include "PerlinNoise.hpp"
-
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
+#include "meshdata.h"
+#include "mesher.h"
+#include "voxelstore.h"
+#include "blockregistry.h"
+#include "chunkio.h"
+#include "memstats.h"
+#include "telemetry.h"
 #include "glm/glm.hpp"
 
+// Whatever the renderer keeps on the GPU for a chunk, see ChunkGpu. The chunk
+// owns it so it goes away with the chunk, but never looks inside, which keeps
+// chunks and the world free of GL.
+class ChunkGpuResource{
+    public:
+        virtual ~ChunkGpuResource(){}
+        virtual size_t Bytes() = 0;
+};
+
+// One column of the world. Holds its voxels in a VoxelStore, generates them
+// and meshes them with a ChunkMesher on the workers, and keeps the finished
+// mesh for the renderer to upload. Needs no GL context.
 class Chunk{
     public:
         float noisescale = 0.025;
         int octaves = 4;
         float persistence = 0.9f;
         float threshold = 0.4;
+        siv::PerlinNoise::seed_type seed = 0;
 
         int xCoord, zCoord;
 
         // 0 - Ungenerated
         // 1 - Generating
         // 2 - Generated
-        // 3 - OpenGL Buffers Allocated
+        // 3 - Uploaded by the renderer, gpu is set
         // 4 - Deletion in Progress
-        unsigned int chunkState;
+        std::atomic<unsigned int> chunkState;
+
+        // Set by the world when a saved copy of this chunk exists on disk or in the write queue
+        ChunkIO* io = nullptr;
+        bool storedOnDisk = false;
+
+        // Set by SetAt, only modified chunks are written back when unloaded
+        bool modified = false;
+
+        // Pipeline timestamps, reported to telemetry when set by the world
+        PipelineTelemetry* telemetry = nullptr;
+        ChunkTimeline timeline;
+
+        // Set by the world when a queued generation is no longer wanted
+        std::atomic<bool> generationCancelled{false};
+
+        // Set when the blocks came from a chunk server, Generate then only
+        // lights and meshes them
+        bool blocksReceived = false;
 
-        Chunk(int xIn, int zIn, int cXS, int cYS, int cZS){
+        ChunkMesher mesher;
+
+        // Created by the renderer on upload and deleted with the chunk
+        ChunkGpuResource* gpu = nullptr;
+        // Sections whose mesh has changed since the renderer uploaded it
+        unsigned int staleGpuSections = 0;
+
+        Chunk(int xIn, int zIn, int cXS, int cYS, int cZS) : mesher(cXS, cYS, cZS), voxels(cXS, cYS, cZS){
             xCoord = xIn; zCoord = zIn;
             chunkXSize = cXS; chunkYSize = cYS; chunkZSize = cZS;
             chunkState = 0;
-
-            vertexData = new std::vector<glm::vec3>();
-            indicesData = new std::vector<unsigned int>();
+            tickableBlocks.assign(SectionCount(), 0);
         }
 
         ~Chunk(){
             chunkState = 4;
+            delete gpu;
+        }
 
-            RemoveMesh();
+        // Moves an ungenerated chunk to generating, the caller then queues
+        // Generate. False when it was already claimed.
+        bool ClaimGeneration(){
+            unsigned int expected = 0;
+            return chunkState.compare_exchange_strong(expected, 1);
+        }
 
-            if (internalData != nullptr) { delete[] internalData; }
+        // Set by Generate once the blocks are lit, the chunk then waits in the
+        // generating state for the world to queue MeshGenerated
+        std::atomic<bool> blocksReady{false};
 
-            if (vertexData != nullptr){ vertexData->clear(); delete vertexData;}
-            if (indicesData != nullptr){ indicesData->clear(); delete indicesData;}
+        // Queued generation holds on to the chunk until it finishes, a chunk
+        // waiting for its first mesh has no job holding it
+        bool CanDeleteObject(){
+            if (remeshState == 1) { return false; }
+            if (chunkState == 1) { return blocksReady; }
+            return chunkState == 0 || chunkState == 2 || chunkState == 3;
+        }
+
+        // Generates and lights the blocks. The first mesh needs the borders of
+        // the neighbours, which are only read on the main thread, so the world
+        // takes the apron and queues MeshGenerated once blocksReady is set.
+        void Generate(){
+            chunkState = 1;
+            // Left range while queued, hand it back ungenerated so it can be unloaded
+            if (generationCancelled.exchange(false)) { chunkState = 0; return; }
+            timeline.generationStarted = PipelineTelemetry::Now();
+            if (!blocksReceived) { GenerateBlocks(); }
+            GenerateLightData();
+            timeline.generated = PipelineTelemetry::Now();
+
+            if (telemetry != nullptr){
+                telemetry->Record(PipelineStage::QueueWait, timeline.queued, timeline.generationStarted);
+                telemetry->Record(PipelineStage::Generation, timeline.generationStarted, timeline.generated);
+            }
+            blocksReady = true;
         }
 
-        void StartAsyncGeneration(){
-            if (threadedProcess == nullptr && chunkState == 0){
-                threadedProcess = new std::thread (&Chunk::Generate, this);
-                threadedProcess->detach();
+        // Runs on a worker. Meshes a freshly generated chunk from an apron the
+        // world filled on the main thread, see World::BuildApron, and moves it
+        // to generated.
+        void MeshGenerated(unsigned int* apron){
+            MeshScratch& scratch = MeshScratch::ForThread();
+            mesher.Mesh(scratch, apron, AllSections(), targetLod);
+            mesh = scratch.MoveOut();
+            lodLevel = targetLod;
+            FreeApron(apron);
+            timeline.meshed = PipelineTelemetry::Now();
+
+            if (telemetry != nullptr){
+                telemetry->Record(PipelineStage::Meshing, timeline.generated, timeline.meshed);
+                telemetry->Record(PipelineStage::RequestToMeshed, timeline.requested, timeline.meshed);
+                telemetry->Count(PipelineEvent::Meshed);
             }
-            else {
-                threadedProcess = nullptr;
+            chunkState = 2;
+        }
+
+        // Loads the saved copy if there is one, otherwise generates from noise
+        void GenerateBlocks(){
+            if (!(storedOnDisk && LoadInternalData())){
+                GenerateInternalData();
             }
+            CountTickableBlocks();
         }
 
-        bool CanDeleteObject(){
-            if (threadedProcess != nullptr && (chunkState == 0 || chunkState == 2 || chunkState == 3)){ //} || chunkState == 3 || threadedProcess == nullptr){
-                return true;
+        // Takes the blocks of a chunk sent by a server
+        void ReceiveBlocks(const unsigned int* blocks){
+            voxels.AllocateBlocks();
+            std::memcpy(voxels.BlockData(), blocks, voxels.BlockBytes());
+            blocksReceived = true;
+            CountTickableBlocks();
+        }
+
+        // Blocks that get random ticks in a section, kept up to date by SetAt
+        int TickableBlocks(int section){ return tickableBlocks[section]; }
+
+        // Sections are whole y slabs of the voxel array, so each is counted
+        // in one pass over contiguous memory
+        void CountTickableBlocks(){
+            const unsigned int* blocks = voxels.BlockData();
+            for (int s = 0; s < SectionCount(); s++){
+                int begin = voxels.Index(0, s * sectionSize, 0);
+                int end = voxels.Index(0, std::min((s + 1) * sectionSize, chunkYSize), 0);
+                int count = 0;
+                for (int i = begin; i < end; i++) { count += BlockRegistry::Ticks(blocks[i]); }
+                tickableBlocks[s] = count;
             }
-            return false;
         }
 
-        void Generate(){
-            chunkState = 1;
-            GenerateInternalData();
-            GenerateMeshData();
-            chunkState = 2;
+        // nullptr until the blocks are generated, loaded or received
+        const unsigned int* BlockData(){ return voxels.BlockData(); }
+        size_t BlockBytes(){ return voxels.BlockBytes(); }
+
+        // Where a block sits in BlockData, edits exchanged with a server are
+        // addressed this way
+        int BlockIndex(glm::ivec3 local){ return voxels.Index(local.x, local.y, local.z); }
+        glm::ivec3 BlockPosition(int index){
+            glm::ivec3 local;
+            voxels.Position(index, local.x, local.y, local.z);
+            return local;
+        }
+
+        bool LoadInternalData(){
+            voxels.AllocateBlocks();
+            return io != nullptr && io->Load(xCoord, zCoord, voxels.BlockData());
         }
 
         void GenerateInternalData(){
-            const siv::PerlinNoise::seed_type seed = 0;
             const siv::PerlinNoise perlin{ seed };
 
-            internalData = new unsigned int[chunkXSize * chunkYSize * chunkZSize];
-            for (size_t i = 0; i < chunkXSize * chunkYSize * chunkZSize; i++) { internalData[i] = 0; }
+            voxels.AllocateBlocks();
+            unsigned int* blocks = voxels.BlockData();
+            for (int i = 0; i < voxels.Volume(); i++) { blocks[i] = Blocks::Air; }
 
             for (int x = 0; x < chunkXSize; x++) {
                 for (int z = 0; z < chunkZSize; z++) {
                     float n = perlin.octave2D_01((xCoord * chunkXSize + x) * noisescale, (zCoord * chunkZSize + z) * noisescale, octaves, 0.5f);
                     if (n < 0.1) { n = 0.1; }
                     if (n > 1.0) { n = 1.0; }
-                    for (size_t y = 0; y < (int)(n * chunkYSize); y++) {
-                        int index = x + chunkXSize * chunkZSize * y + chunkZSize * z;
-                        if (internalData != nullptr && index < chunkXSize * chunkYSize * chunkZSize){
-                            internalData[index] = 1;
+                    // Grass on top of a few blocks of dirt, stone below
+                    int height = (int)(n * chunkYSize);
+                    for (int y = 0; y < height; y++) {
+                        int index = voxels.Index(x, y, z);
+                        if (index < voxels.Volume()){
+                            int depth = height - 1 - y;
+                            blocks[index] = depth == 0 ? Blocks::Grass : (depth <= 3 ? Blocks::Dirt : Blocks::Stone);
                         }
                     }
                 }
             }
-        } 
+        }
 
-        void GenerateMeshData(){
-            if (vertexData != nullptr){ vertexData->clear(); delete vertexData; }
-            vertexData = new std::vector<glm::vec3>();
-            if (indicesData != nullptr){ indicesData->clear(); delete indicesData; }
-            indicesData = new std::vector<unsigned int>();
-
-            for (size_t z = 0; z < chunkZSize; z++){
-                for (size_t y = 0; y < chunkYSize; y++){
-                    for (size_t x = 0; x < chunkXSize; x++){
-                        if (GetAt(x, y, z) != 0) {
-                            GenerateVoxel(glm::vec3(x, y, z));
-                        }
+        // Seeds skylight from the column heightmap and flood fills it, together
+        // with any block light, inside this chunk. Neighbouring chunks may still
+        // be generating, so light only crosses chunk borders on later edits.
+        void GenerateLightData(){
+            int volume = voxels.Volume();
+            voxels.AllocateLight();
+            unsigned int* blocks = voxels.BlockData();
+            unsigned char* lightData = voxels.LightData();
+            std::memset(lightData, 0, volume);
+
+            std::vector<int>& queue = LightQueue();
+            queue.clear();
+
+            for (int z = 0; z < chunkZSize; z++){
+                for (int x = 0; x < chunkXSize; x++){
+                    int top = chunkYSize - 1;
+                    while (top >= 0 && !BlockRegistry::Opaque(GetAt(x, top, z))) { top--; }
+                    for (int y = chunkYSize - 1; y > top; y--){
+                        lightData[voxels.Index(x, y, z)] = 15 << 4;
                     }
                 }
             }
-        }
 
-        void GenerateVoxel(glm::vec3 pos){
-            if (GetAt(pos.x + 1, pos.y, pos.z) == 0){
-                GenerateTri(pos + ozz, pos + ooz, pos + ooo);
-                GenerateTri(pos + ozz, pos + ozo, pos + ooo);
-            }
-            if (GetAt(pos.x, pos.y + 1, pos.z) == 0){
-                GenerateTri(pos + zoz, pos + ooz, pos + ooo);
-                GenerateTri(pos + zoz, pos + zoo, pos + ooo);
+            for (int i = 0; i < volume; i++){
+                lightData[i] |= BlockRegistry::Emission(blocks[i]);
+                if (lightData[i] != 0) { queue.push_back(i); }
             }
-            if (GetAt(pos.x, pos.y, pos.z + 1) == 0){
-                GenerateTri(pos + zzo, pos + ozo, pos + ooo);
-                GenerateTri(pos + zzo, pos + zoo, pos + ooo);
-            }
-            if (GetAt(pos.x - 1, pos.y, pos.z) == 0){
-                GenerateTri(pos, pos + zoz, pos + zoo);
-                GenerateTri(pos, pos + zzo, pos + zoo);
-            }
-            if (GetAt(pos.x, pos.y - 1, pos.z) == 0){
-                GenerateTri(pos, pos + ozz, pos + ozo);
-                GenerateTri(pos, pos + zzo, pos + ozo);
-            }
-            if (GetAt(pos.x, pos.y, pos.z - 1) == 0){
-                GenerateTri(pos, pos + ozz, pos + ooz);
-                GenerateTri(pos, pos + zoz, pos + ooz);
+
+            const int step[3] = { 1, chunkXSize * chunkZSize, chunkZSize };
+            const int size[3] = { chunkXSize, chunkYSize, chunkZSize };
+            for (size_t head = 0; head < queue.size(); head++){
+                int i = queue[head];
+                int pos[3] = { i % chunkXSize, i / (chunkXSize * chunkZSize), (i / chunkZSize) % chunkZSize };
+                int sky = lightData[i] >> 4, block = lightData[i] & 15;
+
+                for (int axis = 0; axis < 3; axis++){
+                    for (int sign = -1; sign <= 1; sign += 2){
+                        int p = pos[axis] + sign;
+                        if (p < 0 || p >= size[axis]) { continue; }
+                        int n = i + sign * step[axis];
+                        if (BlockRegistry::Opaque(blocks[n])) { continue; }
+
+                        int nSky = lightData[n] >> 4, nBlock = lightData[n] & 15;
+                        int wantSky = (axis == 1 && sign == -1 && sky == 15) ? 15 : sky - 1;
+                        bool changed = false;
+                        if (wantSky > nSky) { nSky = wantSky; changed = true; }
+                        if (block - 1 > nBlock) { nBlock = block - 1; changed = true; }
+                        if (changed){
+                            lightData[n] = (unsigned char)((nSky << 4) | nBlock);
+                            queue.push_back(n);
+                        }
+                    }
+                }
             }
         }
 
-        void GenerateTri(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3){
-            unsigned int v1Index = AddVertex(v1);
-            unsigned int v2Index = AddVertex(v2);
-            unsigned int v3Index = AddVertex(v3);
+        unsigned char GetLight(int x, int y, int z){ return voxels.GetLight(x, y, z); }
+        unsigned char GetSkyLight(int x, int y, int z){ return GetLight(x, y, z) >> 4; }
+        unsigned char GetBlockLight(int x, int y, int z){ return GetLight(x, y, z) & 15; }
+        void SetSkyLight(int x, int y, int z, unsigned char level){ voxels.SetSkyLight(x, y, z, level); }
+        void SetBlockLight(int x, int y, int z, unsigned char level){ voxels.SetBlockLight(x, y, z, level); }
+
+        // Meshes at targetLod, set by the world from the chunk's distance when
+        // generation was scheduled
+        void GenerateMeshData(){
+            MeshScratch& scratch = MeshScratch::ForThread();
+            scratch.apron.resize(ApronSize());
+            FillApron(scratch.apron.data());
 
-            PushTri(v1Index, v2Index, v3Index);
+            mesher.Mesh(scratch, scratch.apron.data(), AllSections(), targetLod);
+            mesh = scratch.MoveOut();
+            lodLevel = targetLod;
         }
 
-        void PushTri(unsigned int x, unsigned int y, unsigned int z){
-            if (indicesData != nullptr){
-                indicesData->push_back(x);
-                indicesData->push_back(y);
-                indicesData->push_back(z);
+        // Runs on a worker. Remeshes the sections in mask from an apron the world
+        // filled on the main thread and keeps the other sections of the current
+        // mesh. The result is picked up by ApplyRemesh.
+        void Remesh(unsigned int* apron, unsigned int mask, int level){
+            MeshScratch& scratch = MeshScratch::ForThread();
+            mesher.Mesh(scratch, apron, mask, level);
+            MeshData result = level == 0 ? scratch.MoveOut(&mesh, mask) : scratch.MoveOut();
+            FreeApron(apron);
+
+            {
+                std::lock_guard<std::mutex> guard(remeshLock);
+                remeshResult = std::move(result);
+                remeshSections = mask;
+                remeshLevel = level;
             }
+            remeshState = 2;
         }
 
-        unsigned int AddVertex(glm::vec3 vert){
-            if (vertexData != nullptr){
-                int result = FindVertex(vert);
-                if (result != -1){
-                    return (unsigned int) result;
-                }
-                unsigned int index = vertexData->size();
-                vertexData->push_back(vert);
-                return index;
+        // Called on the main thread once Remesh has finished. The changed
+        // sections are left in staleGpuSections for the renderer.
+        void ApplyRemesh(){
+            {
+                std::lock_guard<std::mutex> guard(remeshLock);
+                mesh = std::move(remeshResult);
+                lodLevel = remeshLevel;
+                staleGpuSections |= remeshSections;
             }
-            return 0;
+            remeshState = 0;
         }
 
-        int FindVertex(glm::vec3 vert){
-            if (vertexData != nullptr){
-                for (size_t i = 0; i < vertexData->size(); i++){
-                    if (vertexData->size() > i){
-                        if (vert == vertexData->at(i)){
-                            return i;
-                        }
-                    } else { break; }
+        int ApronSize(){ return mesher.ApronSize(); }
+
+        unsigned int ApronValue(int x, int y, int z){
+            return GetAt(x, y, z) | ((unsigned int)GetLight(x, y, z) << ChunkMesher::apronLightShift);
+        }
+
+        // Copies this chunk into the apron and treats everything outside as solid
+        void FillApron(unsigned int* apron){
+            for (int i = 0; i < ApronSize(); i++) { apron[i] = Blocks::Stone; }
+            unsigned int* blockData = voxels.BlockData();
+            unsigned char* lightData = voxels.LightData();
+            if (blockData == nullptr) { return; }
+
+            for (int y = 0; y < chunkYSize; y++){
+                for (int z = 0; z < chunkZSize; z++){
+                    unsigned int* row = apron + mesher.ApronIndex(0, y, z);
+                    const unsigned int* blocks = blockData + voxels.Index(0, y, z);
+                    const unsigned char* light = lightData != nullptr ? lightData + voxels.Index(0, y, z) : nullptr;
+                    for (int x = 0; x < chunkXSize; x++){
+                        row[x] = blocks[x] | (light != nullptr ? (unsigned int)light[x] << ChunkMesher::apronLightShift : 0);
+                    }
                 }
             }
-            return -1;
         }
 
-        unsigned int GetAt(unsigned int x, unsigned int y, unsigned int z){
-            if (y >= chunkYSize){ return 1; }
-            if (x < 0 || x >= chunkXSize || y < 0 || z < 0 || z >= chunkZSize){
-                return 1;
-            }
-            if (internalData != nullptr){
-                return internalData[x + chunkXSize * chunkZSize * y + chunkZSize * z];
+        // Copies the blocks of a neighbouring chunk that border this one into the
+        // apron. dx and dz give the neighbour's offset, diagonals included.
+        void CopyApronFrom(Chunk* neighbour, int dx, int dz, unsigned int* apron){
+            int xFrom = dx < 0 ? -1 : (dx > 0 ? chunkXSize : 0), xTo = dx < 0 ? -1 : (dx > 0 ? chunkXSize : chunkXSize - 1);
+            int zFrom = dz < 0 ? -1 : (dz > 0 ? chunkZSize : 0), zTo = dz < 0 ? -1 : (dz > 0 ? chunkZSize : chunkZSize - 1);
+
+            for (int y = 0; y < chunkYSize; y++){
+                for (int z = zFrom; z <= zTo; z++){
+                    for (int x = xFrom; x <= xTo; x++){
+                        apron[mesher.ApronIndex(x, y, z)] = neighbour->ApronValue(x - dx * chunkXSize, y, z - dz * chunkZSize);
+                    }
+                }
             }
-            return 0;
         }
 
-        void SetAt(unsigned int x, unsigned int y, unsigned int z, unsigned int val){
-            int index = x + chunkXSize * chunkZSize * y + chunkZSize * z;
-            if (internalData != nullptr && index >= 0 && index < chunkXSize * chunkYSize * chunkZSize){
-                internalData[index] = val;
-            }
+        // Aprons handed to the workers are allocated by the world
+        void FreeApron(unsigned int* apron){
+            delete[] apron;
+            MemoryStats::Freed(MemoryTag::JobQueues, ApronSize() * sizeof(unsigned int));
         }
 
-        void SetupMesh(){
-            glGenVertexArrays(1, &VAO);
-            glGenBuffers(1, &VBO);
-            glGenBuffers(1, &EBO);
+        int SectionCount(){ return mesher.SectionCount(); }
+        unsigned int AllSections(){ return mesher.AllSections(); }
 
-            glBindVertexArray(VAO);
+        void MarkDirty(int section){
+            if (section >= 0 && section < SectionCount()) { dirtySections |= 1u << section; }
+        }
 
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, vertexData->size() * sizeof(glm::vec3), &vertexData->at(0), GL_STATIC_DRAW);
+        unsigned int GetAt(unsigned int x, unsigned int y, unsigned int z){ return voxels.GetBlock(x, y, z); }
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesData->size() * sizeof(unsigned int), &indicesData->at(0), GL_STATIC_DRAW);
+        void SetAt(unsigned int x, unsigned int y, unsigned int z, unsigned int val){
+            unsigned int old = voxels.GetBlock(x, y, z);
+            if (!voxels.SetBlock(x, y, z, val)) { return; }
+            modified = true;
+
+            // Faces on a section boundary belong to the section on either side
+            int section = y / sectionSize;
+            tickableBlocks[section] += (int)BlockRegistry::Ticks(val) - (int)BlockRegistry::Ticks(old);
+            MarkDirty(section);
+            if (y % sectionSize == 0) { MarkDirty(section - 1); }
+            if (y % sectionSize == sectionSize - 1) { MarkDirty(section + 1); }
+        }
 
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        // Hands the voxel buffer to the caller, used to pass it to the write queue on
+        // unload. It stays accounted as voxels until ChunkIO::Enqueue takes it.
+        unsigned int* ReleaseData(){ return voxels.ReleaseBlocks(); }
 
-            glBindBuffer(GL_ARRAY_BUFFER, 0); 
+        // What the renderer uploads, only changed on the main thread
+        const MeshData& GetMesh(){ return mesh; }
 
-            glBindVertexArray(0); 
+        // Drops the GPU copy but keeps the mesh, so the renderer can upload it again
+        void ReleaseGpu(){
+            if (chunkState != 3) { return; }
+            delete gpu;
+            gpu = nullptr;
+            staleGpuSections = 0;
+            chunkState = 2;
+        }
 
-            chunkState = 3;
+        // Voxels, light and the mesh held in system memory
+        size_t CpuBytes(){
+            return voxels.Bytes() + mesh.vertexCount * sizeof(Vertex) + mesh.indexCount * sizeof(unsigned int);
         }
 
-        void RemoveMesh(){
-            glDeleteVertexArrays(1, &VAO);
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
+        size_t GpuBytes(){ return gpu != nullptr ? gpu->Bytes() : 0; }
+
+        // Triangles in the current mesh, all sections together
+        size_t TriangleCount(){ return mesh.indexCount / 3; }
+
+        // Face connectivity of a section, see ChunkMesher::ComputeVisibility.
+        // Until a mesh exists every face is treated as seeing every other one.
+        unsigned long long SectionVisibility(int section){
+            unsigned int state = chunkState;
+            if (state < 2 || state == 4 || section >= mesh.sectionCount) { return ~0ull; }
+            return mesh.sections[section].visibility;
         }
 
-        void Draw(){
-            if (indicesData != nullptr){
-                glBindVertexArray(VAO);
-                glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indicesData->size()), GL_UNSIGNED_INT, 0);
-                glBindVertexArray(0);
+        // Height of the solid box at the bottom of the chunk, rasterized by the
+        // occlusion culler
+        int OccluderHeight(){
+            unsigned int state = chunkState;
+            if (state < 2 || state == 4) { return 0; }
+
+            int height = 0;
+            for (int s = 0; s < mesh.sectionCount; s++){
+                height += mesh.sections[s].solidLayers;
+                int layers = std::min(chunkYSize, (s + 1) * sectionSize) - s * sectionSize;
+                if ((int)mesh.sections[s].solidLayers < layers) { break; }
             }
+            return height;
         }
 
+        static const int sectionSize = ChunkMesher::sectionSize;
+
+        // Sections touched by SetAt since the last remesh was scheduled
+        std::atomic<unsigned int> dirtySections{0};
+
+        // 0 - Idle
+        // 1 - Remesh running on a worker
+        // 2 - Remesh finished, waiting for ApplyRemesh
+        std::atomic<int> remeshState{0};
+
+        static const int maxLod = ChunkMesher::maxLod;
+        std::atomic<int> lodLevel{0};
+        int targetLod = 0;
+
+        // Neighbours whose blocks were in the apron of the latest mesh, one bit
+        // per (dx + 1) + (dz + 1) * 3. Only used on the main thread.
+        unsigned int apronNeighbours = 0;
+        // Set once the world has remeshed what was meshed without this chunk,
+        // see World::OnGenerated
+        bool neighboursUpdated = false;
 
     private:
         // Chunk Sizes
         int chunkXSize, chunkYSize, chunkZSize;
 
-        std::thread* threadedProcess = nullptr;
-
-        unsigned int* internalData;
-
-        std::vector<glm::vec3>* vertexData;
-        std::vector<unsigned int>* indicesData;
+        static std::vector<int>& LightQueue(){
+            static thread_local std::vector<int> queue;
+            return queue;
+        }
 
-        // Rendering
-        unsigned int VBO, VAO, EBO;
+        VoxelStore voxels;
+        std::vector<int> tickableBlocks;
 
-        // Mesh Generation
-        glm::vec3 ozz = glm::vec3(1,0,0);
-        glm::vec3 ooz = glm::vec3(1,1,0);
-        glm::vec3 ooo = glm::vec3(1,1,1);
-        glm::vec3 ozo = glm::vec3(1,0,1);
-        glm::vec3 zoz = glm::vec3(0,1,0);
-        glm::vec3 zoo = glm::vec3(0,1,1);
-        glm::vec3 zzo = glm::vec3(0,0,1);
+        MeshData mesh;
 
+        std::mutex remeshLock;
+        MeshData remeshResult;
+        unsigned int remeshSections = 0;
+        int remeshLevel = 0;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,113 @@
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include <list>
+#include <map>
+#include <functional>
+
+#include "chunk.h"
+
+// Chunks that have left the render range but are kept in case the camera
+// comes back. Entries are ordered by when they left, and once the cache is
+// over memoryBudget the oldest entries give up their GPU buffers first, then
+// the oldest are evicted entirely through onEvict. A chunk taken back that
+// still has its buffers is drawn straight away, one without them only needs
+// its mesh uploading again.
+class ChunkCache{
+    public:
+        struct Stats{
+            size_t hits;            // taken back with buffers still uploaded
+            size_t reuploads;       // taken back, buffers had been released
+            size_t misses;          // not cached, had to be generated or loaded
+            size_t gpuReleases;
+            size_t evictions;
+        };
+
+        // Bytes of voxels, light, meshes and GPU buffers held by cached chunks
+        size_t memoryBudget = 96 * 1024 * 1024;
+
+        // Receives chunks evicted from the cache, which then owns them
+        std::function<void(Chunk*)> onEvict;
+
+        Stats stats = {};
+
+        ~ChunkCache(){ Clear(); }
+
+        // Only generated chunks are worth keeping, the caller disposes of the rest
+        void Insert(Chunk* ch){
+            Entry entry = Entry{ ch, ch->CpuBytes(), ch->GpuBytes() };
+            lru.push_front(entry);
+            index[Key(ch->xCoord, ch->zCoord)] = lru.begin();
+            cachedBytes += entry.cpuBytes + entry.gpuBytes;
+            Trim();
+        }
+
+        // Removes and returns the cached chunk at the coordinates, or nullptr
+        Chunk* Take(int xCoord, int zCoord){
+            std::map< std::pair<int, int>, std::list<Entry>::iterator >::iterator it = index.find(Key(xCoord, zCoord));
+            if (it == index.end()) { stats.misses++; return nullptr; }
+
+            Entry entry = *it->second;
+            cachedBytes -= entry.cpuBytes + entry.gpuBytes;
+            lru.erase(it->second);
+            index.erase(it);
+
+            if (entry.chunk->chunkState == 3) { stats.hits++; }
+            else { stats.reuploads++; }
+            return entry.chunk;
+        }
+
+        void Trim(){
+            // Buffers go first, oldest first
+            for (std::list<Entry>::reverse_iterator it = lru.rbegin(); cachedBytes > memoryBudget && it != lru.rend(); it++){
+                if (it->gpuBytes == 0) { continue; }
+                it->chunk->ReleaseGpu();
+                cachedBytes -= it->gpuBytes;
+                it->gpuBytes = 0;
+                stats.gpuReleases++;
+            }
+
+            while (cachedBytes > memoryBudget && !lru.empty()){
+                Entry entry = lru.back();
+                lru.pop_back();
+                index.erase(Key(entry.chunk->xCoord, entry.chunk->zCoord));
+                cachedBytes -= entry.cpuBytes + entry.gpuBytes;
+                stats.evictions++;
+                onEvict(entry.chunk);
+            }
+        }
+
+        // Evicts everything
+        void Clear(){
+            while (!lru.empty()){
+                Chunk* ch = lru.back().chunk;
+                lru.pop_back();
+                onEvict(ch);
+            }
+            index.clear();
+            cachedBytes = 0;
+        }
+
+        size_t Count(){ return lru.size(); }
+        size_t Bytes(){ return cachedBytes; }
+
+        float HitRate(){
+            size_t lookups = stats.hits + stats.reuploads + stats.misses;
+            return lookups > 0 ? (float)(stats.hits + stats.reuploads) / lookups : 0.0f;
+        }
+
+    private:
+        struct Entry{
+            Chunk* chunk;
+            size_t cpuBytes, gpuBytes;
+        };
+
+        // Front is the chunk that left range most recently
+        std::list<Entry> lru;
+        std::map< std::pair<int, int>, std::list<Entry>::iterator > index;
+        size_t cachedBytes = 0;
+
+        static std::pair<int, int> Key(int xCoord, int zCoord){ return std::pair<int, int>(xCoord, zCoord); }
+};
+
+#endif
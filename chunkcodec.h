@@ -0,0 +1,316 @@
+#ifndef CHUNKCODEC_H
+#define CHUNKCODEC_H
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#ifdef BLOCKGAME_ZSTD
+#include <zstd.h>
+#endif
+#ifdef BLOCKGAME_LZ4
+#include <lz4.h>
+#endif
+
+#include "rle.h"
+
+// How a ChunkData payload stores the chunk's block ids
+namespace ChunkEncoding {
+    enum : uint32_t {
+        Raw = 0,        // the voxel array as is, 4 bytes per block
+        Packed = 1,     // palette, then bit-packed or run length coded indices
+        PackedLz4 = 2,  // Packed compressed with LZ4, needs BLOCKGAME_LZ4
+        PackedZstd = 3, // Packed compressed with zstd, needs BLOCKGAME_ZSTD
+        Count
+    };
+}
+
+constexpr const char* chunkEncodingNames[ChunkEncoding::Count] = { "raw", "packed", "packed_lz4", "packed_zstd" };
+
+// Compact chunk payloads for the network. Packed lists the distinct block ids
+// once, in order of first appearance, then stores each block as an index into
+// that palette, whichever of these two layouts is smaller:
+//
+//   bits: indices of just enough bits for the palette, least significant first
+//   runs: varint run length, varint palette index, like the region store's RLE
+//
+// Layered terrain is mostly long runs, so it nearly always takes the second.
+//
+//   varint palette size, varint id per entry, uint8 layout, indices
+//
+// The compressed encodings wrap a Packed payload as uint32 packed size then
+// the compressor's output. Everything is in host byte order.
+namespace ChunkCodec {
+    enum : unsigned char { LayoutBits = 0, LayoutRuns = 1 };
+
+    // Bit per encoding this build can write and read
+    inline uint32_t Supported(){
+        uint32_t mask = (1u << ChunkEncoding::Raw) | (1u << ChunkEncoding::Packed);
+#ifdef BLOCKGAME_LZ4
+        mask |= 1u << ChunkEncoding::PackedLz4;
+#endif
+#ifdef BLOCKGAME_ZSTD
+        mask |= 1u << ChunkEncoding::PackedZstd;
+#endif
+        return mask;
+    }
+
+    // Smallest encoding both ends support
+    inline uint32_t Best(uint32_t accepted){
+        accepted &= Supported();
+        const uint32_t order[] = { ChunkEncoding::PackedZstd, ChunkEncoding::PackedLz4, ChunkEncoding::Packed };
+        for (uint32_t encoding : order){
+            if (accepted & (1u << encoding)) { return encoding; }
+        }
+        return ChunkEncoding::Raw;
+    }
+
+    inline int VarintSize(unsigned int value){
+        int size = 1;
+        while (value >= 0x80) { value >>= 7; size++; }
+        return size;
+    }
+
+    inline void EncodePacked(const unsigned int* data, size_t count, std::vector<unsigned char>& out){
+        // Runs of equal ids first, so the palette is looked up once per run.
+        // Ids below 256 are looked up directly, anything above by search.
+        static thread_local std::vector<unsigned int> palette;
+        static thread_local std::vector< std::pair<unsigned int, unsigned int> > runs;
+        palette.clear();
+        runs.clear();
+        int slot[256];
+        for (int i = 0; i < 256; i++) { slot[i] = -1; }
+
+        size_t runBytes = 0;
+        for (size_t i = 0; i < count; ){
+            unsigned int id = data[i];
+            size_t run = 1;
+            while (i + run < count && data[i + run] == id) { run++; }
+
+            int index = id < 256 ? slot[id] : -1;
+            for (size_t p = 0; index < 0 && id >= 256 && p < palette.size(); p++){
+                if (palette[p] == id) { index = (int)p; }
+            }
+            if (index < 0){
+                index = (int)palette.size();
+                palette.push_back(id);
+                if (id < 256) { slot[id] = index; }
+            }
+
+            runs.push_back(std::make_pair((unsigned int)run, (unsigned int)index));
+            runBytes += VarintSize((unsigned int)run) + VarintSize((unsigned int)index);
+            i += run;
+        }
+
+        RLE::PutVarint(out, (unsigned int)palette.size());
+        for (size_t p = 0; p < palette.size(); p++) { RLE::PutVarint(out, palette[p]); }
+
+        int bits = 0;
+        while ((1u << bits) < palette.size()) { bits++; }
+        size_t bitBytes = (count * bits + 7) / 8;
+
+        if (runBytes < bitBytes || bits == 0){
+            out.push_back(LayoutRuns);
+            for (size_t r = 0; r < runs.size(); r++){
+                RLE::PutVarint(out, runs[r].first);
+                RLE::PutVarint(out, runs[r].second);
+            }
+            return;
+        }
+
+        out.push_back(LayoutBits);
+        size_t start = out.size();
+        out.resize(start + bitBytes);
+        unsigned char* packed = out.data() + start;
+        uint64_t buffer = 0;
+        int filled = 0;
+        for (size_t r = 0; r < runs.size(); r++){
+            for (unsigned int n = 0; n < runs[r].first; n++){
+                buffer |= (uint64_t)runs[r].second << filled;
+                filled += bits;
+                while (filled >= 8) { *packed++ = (unsigned char)buffer; buffer >>= 8; filled -= 8; }
+            }
+        }
+        if (filled > 0) { *packed = (unsigned char)buffer; }
+    }
+
+    // False if the input is truncated, refers past its palette or does not
+    // hold exactly count blocks
+    inline bool DecodePacked(const unsigned char* in, size_t size, unsigned int* data, size_t count){
+        const unsigned char* end = in + size;
+        unsigned int paletteSize;
+        if (!RLE::GetVarint(in, end, paletteSize) || paletteSize == 0 || paletteSize > count) { return false; }
+        std::vector<unsigned int> palette(paletteSize);
+        for (unsigned int p = 0; p < paletteSize; p++){
+            if (!RLE::GetVarint(in, end, palette[p])) { return false; }
+        }
+        if (in >= end) { return false; }
+        unsigned char layout = *in++;
+
+        if (layout == LayoutRuns){
+            size_t i = 0;
+            while (in < end){
+                unsigned int run, index;
+                if (!RLE::GetVarint(in, end, run) || !RLE::GetVarint(in, end, index)) { return false; }
+                if (run > count - i || index >= paletteSize) { return false; }
+                std::fill_n(data + i, run, palette[index]);
+                i += run;
+            }
+            return i == count;
+        }
+
+        if (layout != LayoutBits) { return false; }
+        int bits = 0;
+        while ((1u << bits) < paletteSize) { bits++; }
+        if ((size_t)(end - in) != (count * bits + 7) / 8) { return false; }
+        uint64_t buffer = 0;
+        int filled = 0;
+        unsigned int mask = (1u << bits) - 1;
+        for (size_t i = 0; i < count; i++){
+            while (filled < bits) { buffer |= (uint64_t)*in++ << filled; filled += 8; }
+            unsigned int index = (unsigned int)buffer & mask;
+            buffer >>= bits;
+            filled -= bits;
+            if (index >= paletteSize) { return false; }
+            data[i] = palette[index];
+        }
+        return true;
+    }
+
+    // Appends count blocks in the given encoding, false if this build cannot write it
+    inline bool Encode(const unsigned int* data, size_t count, uint32_t encoding, std::vector<unsigned char>& out){
+        if (encoding >= ChunkEncoding::Count || (Supported() & (1u << encoding)) == 0) { return false; }
+        if (encoding == ChunkEncoding::Raw){
+            size_t start = out.size();
+            out.resize(start + count * sizeof(unsigned int));
+            std::memcpy(out.data() + start, data, count * sizeof(unsigned int));
+            return true;
+        }
+        if (encoding == ChunkEncoding::Packed) { EncodePacked(data, count, out); return true; }
+
+        std::vector<unsigned char> packed;
+        EncodePacked(data, count, packed);
+        uint32_t packedSize = (uint32_t)packed.size();
+        size_t start = out.size();
+        out.resize(start + 4);
+        std::memcpy(out.data() + start, &packedSize, 4);
+#ifdef BLOCKGAME_LZ4
+        if (encoding == ChunkEncoding::PackedLz4){
+            out.resize(start + 4 + LZ4_compressBound((int)packed.size()));
+            int written = LZ4_compress_default((const char*)packed.data(), (char*)out.data() + start + 4, (int)packed.size(), (int)(out.size() - start - 4));
+            if (written <= 0) { out.resize(start); return false; }
+            out.resize(start + 4 + written);
+            return true;
+        }
+#endif
+#ifdef BLOCKGAME_ZSTD
+        if (encoding == ChunkEncoding::PackedZstd){
+            out.resize(start + 4 + ZSTD_compressBound(packed.size()));
+            size_t written = ZSTD_compress(out.data() + start + 4, out.size() - start - 4, packed.data(), packed.size(), 3);
+            if (ZSTD_isError(written)) { out.resize(start); return false; }
+            out.resize(start + 4 + written);
+            return true;
+        }
+#endif
+        out.resize(start);
+        return false;
+    }
+
+    inline bool Decode(const unsigned char* in, size_t size, uint32_t encoding, unsigned int* data, size_t count){
+        if (encoding >= ChunkEncoding::Count || (Supported() & (1u << encoding)) == 0) { return false; }
+        if (encoding == ChunkEncoding::Raw){
+            if (size != count * sizeof(unsigned int)) { return false; }
+            std::memcpy(data, in, size);
+            return true;
+        }
+        if (encoding == ChunkEncoding::Packed) { return DecodePacked(in, size, data, count); }
+
+        uint32_t packedSize;
+        if (size < 4) { return false; }
+        std::memcpy(&packedSize, in, 4);
+        // A packed chunk is never larger than runs of one block each
+        if (packedSize > count * 16 + 64) { return false; }
+        std::vector<unsigned char> packed(packedSize);
+#ifdef BLOCKGAME_LZ4
+        if (encoding == ChunkEncoding::PackedLz4){
+            int read = LZ4_decompress_safe((const char*)in + 4, (char*)packed.data(), (int)(size - 4), (int)packedSize);
+            return read == (int)packedSize && DecodePacked(packed.data(), packedSize, data, count);
+        }
+#endif
+#ifdef BLOCKGAME_ZSTD
+        if (encoding == ChunkEncoding::PackedZstd){
+            size_t read = ZSTD_decompress(packed.data(), packedSize, in + 4, size - 4);
+            return !ZSTD_isError(read) && read == packedSize && DecodePacked(packed.data(), packedSize, data, count);
+        }
+#endif
+        return false;
+    }
+}
+
+// Block edits made during one tick, grouped by chunk. Repeated edits of a
+// block keep only the last value. On the wire:
+//
+//   varint chunk count, then per chunk zigzag varint x and z, varint edit
+//   count, then per edit varint block index and varint block id
+//
+// The block index is the block's position in the chunk's voxel array.
+class DeltaBatch{
+    public:
+        void Add(int xCoord, int zCoord, unsigned int index, unsigned int block){
+            std::vector< std::pair<unsigned int, unsigned int> >& edits = chunks[std::pair<int, int>(xCoord, zCoord)];
+            for (size_t i = 0; i < edits.size(); i++){
+                if (edits[i].first == index) { edits[i].second = block; return; }
+            }
+            edits.push_back(std::make_pair(index, block));
+            count++;
+        }
+
+        bool Empty(){ return count == 0; }
+        size_t Edits(){ return count; }
+
+        void Clear(){ chunks.clear(); count = 0; }
+
+        void Encode(std::vector<unsigned char>& out){
+            RLE::PutVarint(out, (unsigned int)chunks.size());
+            std::map< std::pair<int, int>, std::vector< std::pair<unsigned int, unsigned int> > >::iterator it;
+            for (it = chunks.begin(); it != chunks.end(); it++){
+                RLE::PutVarint(out, ZigZag(it->first.first));
+                RLE::PutVarint(out, ZigZag(it->first.second));
+                RLE::PutVarint(out, (unsigned int)it->second.size());
+                for (size_t i = 0; i < it->second.size(); i++){
+                    RLE::PutVarint(out, it->second[i].first);
+                    RLE::PutVarint(out, it->second[i].second);
+                }
+            }
+        }
+
+        // Calls onEdit(x, z, index, block) for every edit, false if the input is malformed
+        template <typename Callback>
+        static bool Decode(const unsigned char* in, size_t size, Callback onEdit){
+            const unsigned char* end = in + size;
+            unsigned int chunkCount;
+            if (!RLE::GetVarint(in, end, chunkCount)) { return false; }
+            for (unsigned int c = 0; c < chunkCount; c++){
+                unsigned int x, z, edits;
+                if (!RLE::GetVarint(in, end, x) || !RLE::GetVarint(in, end, z) || !RLE::GetVarint(in, end, edits)) { return false; }
+                for (unsigned int e = 0; e < edits; e++){
+                    unsigned int index, block;
+                    if (!RLE::GetVarint(in, end, index) || !RLE::GetVarint(in, end, block)) { return false; }
+                    onEdit(UnZigZag(x), UnZigZag(z), index, block);
+                }
+            }
+            return in == end;
+        }
+
+    private:
+        std::map< std::pair<int, int>, std::vector< std::pair<unsigned int, unsigned int> > > chunks;
+        size_t count = 0;
+
+        static unsigned int ZigZag(int value){ return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31); }
+        static int UnZigZag(unsigned int value){ return (int)(value >> 1) ^ -(int)(value & 1); }
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef CHUNKGPU_H
+#define CHUNKGPU_H
+
+#include <vector>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+#include "chunk.h"
+#include "meshdata.h"
+#include "mesher.h"
+#include "memstats.h"
+#include "glm/glm.hpp"
+
+// The GL side of one chunk: a vertex array with a single vertex and index
+// buffer holding every section of its mesh. Made and used by WorldRenderer on
+// the render thread, owned by the chunk through Chunk::gpu.
+class ChunkGpu : public ChunkGpuResource{
+    public:
+        ChunkGpu(){
+            glGenVertexArrays(1, &VAO);
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &EBO);
+
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(Vertex), (void*)offsetof(Vertex, data));
+
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindVertexArray(0);
+        }
+
+        ~ChunkGpu(){
+            if (!gpuSections.empty()) { MemoryStats::Freed(MemoryTag::GpuBuffers, Bytes()); }
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &EBO);
+        }
+
+        // Lays the buffers out for the whole mesh and uploads every section
+        void Upload(const MeshData& mesh){
+            if (!gpuSections.empty()) { MemoryStats::Freed(MemoryTag::GpuBuffers, Bytes()); }
+            gpuSections.resize(mesh.sectionCount);
+            unsigned int vertexTotal = 0, indexTotal = 0;
+            for (int s = 0; s < mesh.sectionCount; s++){
+                GpuSection& slot = gpuSections[s];
+                slot.vertexOffset = vertexTotal;
+                slot.vertexCapacity = SlotCapacity(mesh.sections[s].vertexCount);
+                slot.indexOffset = indexTotal;
+                slot.indexCapacity = SlotCapacity(mesh.sections[s].indexCount);
+                vertexTotal += slot.vertexCapacity;
+                indexTotal += slot.indexCapacity;
+            }
+
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, vertexTotal * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexTotal * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+            for (int s = 0; s < mesh.sectionCount; s++) { UploadSection(mesh, s); }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindVertexArray(0);
+            MemoryStats::Allocated(MemoryTag::GpuBuffers, Bytes());
+        }
+
+        // Re-uploads the sections in mask after a remesh. Sections that still
+        // fit their slot are patched in place with glBufferSubData, otherwise
+        // the buffers are laid out again.
+        void Update(const MeshData& mesh, unsigned int mask){
+            bool fits = gpuSections.size() == (size_t)mesh.sectionCount;
+            for (int s = 0; fits && s < mesh.sectionCount; s++){
+                if ((mask & (1u << s)) == 0) { continue; }
+                fits = mesh.sections[s].vertexCount <= gpuSections[s].vertexCapacity &&
+                       mesh.sections[s].indexCount <= gpuSections[s].indexCapacity;
+            }
+            if (!fits) { Upload(mesh); return; }
+
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            for (int s = 0; s < mesh.sectionCount; s++){
+                if (mask & (1u << s)) { UploadSection(mesh, s); }
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindVertexArray(0);
+        }
+
+        // sectionMask selects which vertical sections are drawn. eye is the
+        // camera position relative to the chunk, face directions that point
+        // away from it across the whole section are skipped.
+        void Draw(const MeshData& mesh, const ChunkMesher& mesher, unsigned int sectionMask, glm::vec3 eye){
+            if (mesh.Empty()) { return; }
+
+            glBindVertexArray(VAO);
+            for (size_t s = 0; s < gpuSections.size(); s++){
+                if ((sectionMask & (1u << s)) == 0 || gpuSections[s].indexCount == 0) { continue; }
+
+                unsigned int directions = mesher.FacingDirections(eye, s);
+                const unsigned int* counts = mesh.sections[s].directionIndexCount;
+                unsigned int offset = gpuSections[s].indexOffset;
+
+                // Adjacent directions that are both drawn go out as one call
+                for (int d = 0; d < 6; ){
+                    if ((directions & (1u << d)) == 0) { offset += counts[d]; d++; continue; }
+                    unsigned int start = offset, count = 0;
+                    for (; d < 6 && (directions & (1u << d)); d++) { count += counts[d]; offset += counts[d]; }
+                    if (count > 0){
+                        glDrawElementsBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_INT,
+                                                 (void*)(start * sizeof(unsigned int)), gpuSections[s].vertexOffset);
+                    }
+                }
+            }
+            glBindVertexArray(0);
+        }
+
+        // Size of the buffers allocated by the last upload
+        size_t Bytes() override {
+            size_t bytes = 0;
+            for (size_t s = 0; s < gpuSections.size(); s++){
+                bytes += gpuSections[s].vertexCapacity * sizeof(Vertex) + gpuSections[s].indexCapacity * sizeof(unsigned int);
+            }
+            return bytes;
+        }
+
+    private:
+        unsigned int VBO = 0, VAO = 0, EBO = 0;
+
+        // Where each section lives in the buffers. Slots are sized with some
+        // headroom so that small edits can be re-uploaded in place.
+        struct GpuSection{
+            unsigned int vertexOffset, vertexCapacity;
+            unsigned int indexOffset, indexCapacity;
+            unsigned int indexCount;
+        };
+        std::vector<GpuSection> gpuSections;
+
+        static unsigned int SlotCapacity(unsigned int count){ return count + count / 4 + 64; }
+
+        // Expects the VAO and VBO to be bound
+        void UploadSection(const MeshData& mesh, int s){
+            const MeshRange& r = mesh.sections[s];
+            GpuSection& slot = gpuSections[s];
+            if (r.vertexCount > 0){
+                glBufferSubData(GL_ARRAY_BUFFER, slot.vertexOffset * sizeof(Vertex), r.vertexCount * sizeof(Vertex), mesh.vertices + r.vertexStart);
+            }
+            if (r.indexCount > 0){
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, slot.indexOffset * sizeof(unsigned int), r.indexCount * sizeof(unsigned int), mesh.indices + r.indexStart);
+            }
+            slot.indexCount = r.indexCount;
+        }
+};
+
+#endif
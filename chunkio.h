@@ -0,0 +1,321 @@
+#ifndef CHUNKIO_H
+#define CHUNKIO_H
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <condition_variable>
+
+#ifdef BLOCKGAME_IO_URING
+#include <liburing.h>
+#endif
+
+#include "regionstore.h"
+#include "memstats.h"
+
+// Writes unloaded chunks back to the region store on a dedicated thread.
+// Enqueue takes ownership of the voxel buffer and returns immediately, the I/O
+// thread encodes queued chunks, groups them by region file and issues one
+// append plus one offset table write per region. With BLOCKGAME_IO_URING the
+// writes of a whole batch are submitted together through io_uring, otherwise
+// they go out with pwrite.
+//
+// Chunks stay readable through Contains/Load until their write has landed,
+// so a chunk revisited straight after unloading never falls back to noise.
+// A chunk whose batch fails is saved again on its own with a plain
+// RegionStore::Save, and if that fails too it goes back on the queue for the
+// next batch. Only after maxAttempts failed batches, or when a failure is
+// left over while shutting down, is the buffer dropped, and never silently.
+class ChunkIO{
+    public:
+        struct Stats{
+            size_t queueDepth;      // chunks waiting or being written
+            size_t peakQueueDepth;
+            size_t queuedBytes;     // voxel bytes held by the queue
+            size_t chunksWritten;
+            size_t batchesWritten;
+            size_t writeErrors;
+            size_t chunksLost;      // given up on after every attempt failed
+        };
+
+        // Milliseconds the I/O thread waits after waking to let a burst of unloads coalesce
+        int batchWindow = 50;
+
+        // Batches a chunk may fail before its buffer is given up on
+        int maxAttempts = 3;
+
+        ChunkIO(RegionStore* s, size_t voxels){
+            store = s;
+            voxelCount = voxels;
+            ioThread = std::thread(&ChunkIO::Run, this);
+        }
+
+        // Drains everything still queued before returning
+        ~ChunkIO(){
+            {
+                std::lock_guard<std::mutex> guard(queueLock);
+                stopping = true;
+            }
+            queueSignal.notify_one();
+            ioThread.join();
+        }
+
+        bool Contains(int xCoord, int zCoord){
+            {
+                std::lock_guard<std::mutex> guard(queueLock);
+                std::pair<int, int> key (xCoord, zCoord);
+                if (queued.count(key) > 0 || inFlight.count(key) > 0) { return true; }
+            }
+            return store->Contains(xCoord, zCoord);
+        }
+
+        bool Load(int xCoord, int zCoord, unsigned int* out){
+            {
+                std::lock_guard<std::mutex> guard(queueLock);
+                std::pair<int, int> key (xCoord, zCoord);
+
+                // A queued copy is newer than one already being written
+                std::map< std::pair<int, int>, unsigned int*>::iterator it = queued.find(key);
+                if (it != queued.end()){
+                    std::memcpy(out, it->second, voxelCount * sizeof(unsigned int));
+                    return true;
+                }
+                it = inFlight.find(key);
+                if (it != inFlight.end()){
+                    std::memcpy(out, it->second, voxelCount * sizeof(unsigned int));
+                    return true;
+                }
+            }
+            return store->Load(xCoord, zCoord, out);
+        }
+
+        // Takes ownership of data, which must hold voxelCount values
+        void Enqueue(int xCoord, int zCoord, unsigned int* data){
+            MemoryStats::Transfer(MemoryTag::Voxels, MemoryTag::WriteQueue, voxelCount * sizeof(unsigned int));
+            {
+                std::lock_guard<std::mutex> guard(queueLock);
+                std::pair<int, int> key (xCoord, zCoord);
+
+                unsigned int*& slot = queued[key];
+                if (slot != nullptr){
+                    delete[] slot;
+                    MemoryStats::Freed(MemoryTag::WriteQueue, voxelCount * sizeof(unsigned int));
+                }
+                slot = data;
+
+                size_t depth = queued.size() + inFlight.size();
+                if (depth > stats.peakQueueDepth) { stats.peakQueueDepth = depth; }
+            }
+            queueSignal.notify_one();
+        }
+
+        Stats GetStats(){
+            std::lock_guard<std::mutex> guard(queueLock);
+            Stats s = stats;
+            s.queueDepth = queued.size() + inFlight.size();
+            s.queuedBytes = s.queueDepth * voxelCount * sizeof(unsigned int);
+            return s;
+        }
+
+    private:
+        RegionStore* store;
+        size_t voxelCount;
+
+        std::thread ioThread;
+        std::mutex queueLock;
+        std::condition_variable queueSignal;
+        bool stopping = false;
+
+        std::map< std::pair<int, int>, unsigned int*> queued;
+        std::map< std::pair<int, int>, unsigned int*> inFlight;
+
+        // Failed batches so far of chunks put back on the queue
+        std::map< std::pair<int, int>, int> attempts;
+
+        Stats stats = {};
+
+        void Run(){
+#ifdef BLOCKGAME_IO_URING
+            struct io_uring ring;
+            bool ringReady = io_uring_queue_init(64, &ring, 0) == 0;
+            if (!ringReady) { std::cout << "ERROR::CHUNKIO::IO_URING_UNAVAILABLE falling back to pwrite" << std::endl; }
+#endif
+            std::unique_lock<std::mutex> lock(queueLock);
+            while (true){
+                queueSignal.wait(lock, [this]{ return stopping || !queued.empty(); });
+                if (queued.empty() && stopping) { break; }
+
+                if (!stopping){
+                    queueSignal.wait_for(lock, std::chrono::milliseconds(batchWindow), [this]{ return stopping; });
+                }
+
+                inFlight.swap(queued);
+                lock.unlock();
+
+                std::vector<RegionStore::RegionBatch> batches;
+                std::vector< std::vector<unsigned char> > payloads;
+                std::vector< std::vector< std::pair<int, int> > > batchKeys;
+                std::vector< std::pair<int, int> > failed;
+                PrepareBatches(batches, payloads, batchKeys, failed);
+
+                std::vector<int> results(batches.size(), 0);
+                size_t written = 0, errors = 0;
+#ifdef BLOCKGAME_IO_URING
+                if (ringReady) { SubmitUring(ring, batches, results, written, errors); }
+                else { SubmitPwrite(batches, results, written, errors); }
+#else
+                SubmitPwrite(batches, results, written, errors);
+#endif
+
+                for (size_t i = 0; i < batches.size(); i++){
+                    if (!results[i]) { failed.insert(failed.end(), batchKeys[i].begin(), batchKeys[i].end()); }
+                }
+                SaveFailed(failed, written);
+
+                lock.lock();
+                std::sort(failed.begin(), failed.end());
+                for (auto& it : inFlight){
+                    if (std::binary_search(failed.begin(), failed.end(), it.first)){
+                        if (Requeue(it.first, it.second)) { continue; }
+                    } else if (!attempts.empty()) { attempts.erase(it.first); }
+                    delete[] it.second;
+                    MemoryStats::Freed(MemoryTag::WriteQueue, voxelCount * sizeof(unsigned int));
+                }
+                inFlight.clear();
+                stats.chunksWritten += written;
+                stats.batchesWritten += batches.size();
+                stats.writeErrors += errors;
+            }
+#ifdef BLOCKGAME_IO_URING
+            if (ringReady) { io_uring_queue_exit(&ring); }
+#endif
+        }
+
+        // Encodes everything in flight and groups the payloads into one batch per
+        // region. batchKeys holds the chunks of each batch, chunks whose region
+        // could not be opened are added to failed.
+        void PrepareBatches(std::vector<RegionStore::RegionBatch>& batches, std::vector< std::vector<unsigned char> >& payloads,
+                            std::vector< std::vector< std::pair<int, int> > >& batchKeys, std::vector< std::pair<int, int> >& failed){
+            std::map< std::pair<int, int>, std::vector< std::pair<int, const std::vector<unsigned char>*> > > byRegion;
+            std::map< std::pair<int, int>, std::vector< std::pair<int, int> > > regionKeys;
+
+            payloads.resize(inFlight.size());
+            size_t i = 0;
+            for (auto& it : inFlight) {
+                store->Encode(it.second, payloads[i]);
+                std::pair<int, int> region (RegionStore::RegionCoord(it.first.first), RegionStore::RegionCoord(it.first.second));
+                byRegion[region].push_back(std::make_pair(RegionStore::LocalIndex(it.first.first, it.first.second), &payloads[i]));
+                regionKeys[region].push_back(it.first);
+                i++;
+            }
+
+            for (auto& it : byRegion) {
+                RegionStore::RegionBatch batch;
+                if (store->BeginBatch(it.first.first, it.first.second, it.second, batch)){
+                    batches.push_back(std::move(batch));
+                    batchKeys.push_back(regionKeys[it.first]);
+                } else {
+                    // A half begun batch still holds the region lock
+                    store->EndBatch(batch, false);
+                    std::vector< std::pair<int, int> >& keys = regionKeys[it.first];
+                    failed.insert(failed.end(), keys.begin(), keys.end());
+                    std::cout << "ERROR::CHUNKIO::REGION_UNAVAILABLE " << it.first.first << " " << it.first.second << std::endl;
+                }
+            }
+        }
+
+        void SubmitPwrite(std::vector<RegionStore::RegionBatch>& batches, std::vector<int>& results, size_t& written, size_t& errors){
+            for (size_t i = 0; i < batches.size(); i++) {
+                RegionStore::RegionBatch& b = batches[i];
+                bool ok = pwrite(b.fd, b.data.data(), b.data.size(), b.offset) == (ssize_t)b.data.size() &&
+                          pwrite(b.fd, b.table.data(), RegionStore::tableSize, 8) == (ssize_t)RegionStore::tableSize;
+                results[i] = Finish(b, ok, written, errors);
+            }
+        }
+
+#ifdef BLOCKGAME_IO_URING
+        // Each region contributes a linked pair of writes so its table never lands
+        // before its data. Pairs from different regions are in flight together.
+        void SubmitUring(struct io_uring& ring, std::vector<RegionStore::RegionBatch>& batches, std::vector<int>& results, size_t& written, size_t& errors){
+            const size_t perSubmit = 32;
+            for (size_t start = 0; start < batches.size(); start += perSubmit) {
+                size_t end = std::min(batches.size(), start + perSubmit);
+                std::vector<int> failed(end - start, 0);
+
+                for (size_t i = start; i < end; i++) {
+                    RegionStore::RegionBatch& b = batches[i];
+                    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+                    io_uring_prep_write(sqe, b.fd, b.data.data(), b.data.size(), b.offset);
+                    sqe->flags |= IOSQE_IO_LINK;
+                    io_uring_sqe_set_data(sqe, reinterpret_cast<void*>((i - start) << 1));
+
+                    sqe = io_uring_get_sqe(&ring);
+                    io_uring_prep_write(sqe, b.fd, b.table.data(), RegionStore::tableSize, 8);
+                    io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(((i - start) << 1) | 1));
+                }
+                io_uring_submit(&ring);
+
+                for (size_t n = 0; n < (end - start) * 2; n++) {
+                    struct io_uring_cqe* cqe;
+                    if (io_uring_wait_cqe(&ring, &cqe) != 0) { break; }
+                    size_t tag = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+                    size_t slot = tag >> 1;
+                    size_t expected = (tag & 1) ? RegionStore::tableSize : batches[start + slot].data.size();
+                    if (cqe->res < 0 || (size_t)cqe->res != expected) { failed[slot] = 1; }
+                    io_uring_cqe_seen(&ring, cqe);
+                }
+
+                for (size_t i = start; i < end; i++) { results[i] = Finish(batches[i], failed[i - start] == 0, written, errors); }
+            }
+        }
+#endif
+
+        bool Finish(RegionStore::RegionBatch& b, bool ok, size_t& written, size_t& errors){
+            if (ok) { written += b.indices.size(); }
+            else {
+                errors += b.indices.size();
+                std::cout << "ERROR::CHUNKIO::WRITE_FAILED " << b.indices.size() << " chunks" << std::endl;
+            }
+            store->EndBatch(b, ok);
+            return ok;
+        }
+
+        // Saves the chunks of failed batches one by one, the same way as
+        // RegionStore::Save. Leaves only the chunks that failed again in failed.
+        // Reads inFlight without the lock, only Run ever changes it.
+        void SaveFailed(std::vector< std::pair<int, int> >& failed, size_t& written){
+            std::vector< std::pair<int, int> > stillFailed;
+            for (size_t i = 0; i < failed.size(); i++){
+                if (store->Save(failed[i].first, failed[i].second, inFlight.find(failed[i])->second)) { written++; }
+                else { stillFailed.push_back(failed[i]); }
+            }
+            failed.swap(stillFailed);
+        }
+
+        // Puts a chunk that could not be written back on the queue for the next
+        // batch. Returns false when the buffer should be freed instead, because
+        // a newer copy is queued or the chunk has run out of attempts.
+        // Called with queueLock held.
+        bool Requeue(std::pair<int, int> key, unsigned int* data){
+            if (queued.count(key) > 0) { attempts.erase(key); return false; }
+
+            int& tried = attempts[key];
+            tried++;
+            if (tried >= maxAttempts || stopping){
+                std::cout << "ERROR::CHUNKIO::CHUNK_LOST " << key.first << " " << key.second << " after " << tried << " attempts" << std::endl;
+                attempts.erase(key);
+                stats.chunksLost++;
+                return false;
+            }
+            std::cout << "ERROR::CHUNKIO::WRITE_RETRY " << key.first << " " << key.second << std::endl;
+            queued[key] = data;
+            return true;
+        }
+};
+
+#endif
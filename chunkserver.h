@@ -0,0 +1,409 @@
+#ifndef CHUNKSERVER_H
+#define CHUNKSERVER_H
+
+#include <map>
+#include <set>
+#include <list>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <iostream>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "world.h"
+#include "chunk.h"
+#include "chunkio.h"
+#include "regionstore.h"
+#include "workerpool.h"
+#include "netprotocol.h"
+#include "telemetry.h"
+
+// Generates chunks for any number of clients and streams their blocks back,
+// see netprotocol.h. Chunks are generated once, by the game's own Chunk code
+// on a worker pool, and kept in one cache shared by every client, so clients
+// walking the same ground only pay for it once. Saved chunks in the region
+// store are served as saved.
+//
+// Each chunk is sent in the smallest encoding its client reads, encoded once
+// per encoding and kept with the chunk until it changes. Edits clients send
+// are applied to the cached chunk, saved with it when it is evicted, and
+// forwarded to every other client that was sent the chunk, batched into one
+// message per client per Poll.
+//
+// Everything but generation runs on the thread calling Poll. Workers hand
+// finished chunks back through a queue and wake poll with a self pipe.
+class ChunkServer{
+    public:
+        static const int chunkXSize = World::chunkXSize, chunkYSize = World::chunkYSize, chunkZSize = World::chunkZSize;
+
+        struct Stats{
+            size_t clientsAccepted;
+            size_t requests;
+            size_t served;          // chunks sent
+            size_t cacheHits;       // requests answered straight from the cache
+            size_t shared;          // requests that joined a generation already running
+            size_t generated;
+            size_t evictions;
+            size_t bytesSent;
+            size_t editsReceived;
+            size_t editsForwarded;
+            size_t forgotten;       // chunks clients unloaded
+        };
+
+        // Bytes of generated chunks kept once nobody is waiting on them
+        size_t memoryBudget = 256 * 1024 * 1024;
+
+        Stats stats = {};
+        PipelineTelemetry* telemetry;
+
+        ChunkServer(unsigned int threads){
+            store = new RegionStore("World", chunkXSize * chunkYSize * chunkZSize);
+            io = new ChunkIO(store, chunkXSize * chunkYSize * chunkZSize);
+            workers = new WorkerPool(threads);
+            telemetry = new PipelineTelemetry();
+
+            if (pipe(wakePipe) == 0){
+                fcntl(wakePipe[0], F_SETFL, fcntl(wakePipe[0], F_GETFL, 0) | O_NONBLOCK);
+                fcntl(wakePipe[1], F_SETFL, fcntl(wakePipe[1], F_GETFL, 0) | O_NONBLOCK);
+            }
+        }
+
+        ~ChunkServer(){
+            delete workers;
+
+            std::map<int, Client*>::iterator c;
+            for (c = clients.begin(); c != clients.end(); c++) { delete c->second; }
+            std::map< std::pair<int, int>, Entry >::iterator e;
+            for (e = chunks.begin(); e != chunks.end(); e++) { Unload(e->second.chunk); }
+
+            if (listenFd != -1) { close(listenFd); }
+            if (!unixPath.empty()) { unlink(unixPath.c_str()); }
+            close(wakePipe[0]);
+            close(wakePipe[1]);
+
+            delete telemetry;
+            delete io;
+            delete store;
+        }
+
+        bool Listen(const std::string& address){
+            listenFd = NetAddress::Listen(address);
+            if (listenFd != -1 && NetAddress::IsUnix(address)) { unixPath = address.substr(5); }
+            return listenFd != -1;
+        }
+
+        // Waits up to timeoutMs for something to do, then accepts clients,
+        // answers their requests and sends out finished chunks
+        void Poll(int timeoutMs){
+            std::vector<pollfd> fds;
+            fds.push_back(pollfd{ listenFd, POLLIN, 0 });
+            fds.push_back(pollfd{ wakePipe[0], POLLIN, 0 });
+            std::vector<Client*> polled;
+            for (std::map<int, Client*>::iterator it = clients.begin(); it != clients.end(); it++){
+                Client* client = it->second;
+                fds.push_back(pollfd{ client->conn->fd, (short)(POLLIN | (client->conn->WantsWrite() ? POLLOUT : 0)), 0 });
+                polled.push_back(client);
+            }
+
+            if (poll(fds.data(), fds.size(), timeoutMs) < 0) { return; }
+
+            if (fds[0].revents & POLLIN) { Accept(); }
+            if (fds[1].revents & POLLIN) { CollectFinished(); }
+
+            for (size_t i = 0; i < polled.size(); i++){
+                Client* client = polled[i];
+                if ((fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) == 0) { continue; }
+                client->conn->Receive();
+                Message message;
+                while (client->conn->Next(message)) { Handle(client, message); }
+            }
+
+            // Edits forwarded this Poll go out as one message per client
+            for (size_t i = 0; i < polled.size(); i++){
+                Client* client = polled[i];
+                if (!client->edits.Empty()){
+                    std::vector<unsigned char> body;
+                    client->edits.Encode(body);
+                    client->conn->Send(MessageType::BlockDeltas, body.data(), body.size());
+                    stats.bytesSent += Connection::headerSize + body.size();
+                    client->edits.Clear();
+                }
+                client->conn->Flush();
+                if (!client->conn->Open()) { Disconnect(client); }
+            }
+
+            Trim();
+        }
+
+        size_t ClientCount(){ return clients.size(); }
+        size_t CachedChunks(){ return lru.size(); }
+        size_t CachedBytes(){ return cachedBytes; }
+        size_t Generating(){ return chunks.size() - lru.size(); }
+
+        float HitRate(){
+            return stats.requests > 0 ? (float)(stats.cacheHits + stats.shared) / stats.requests : 0.0f;
+        }
+
+    private:
+        struct Client{
+            int id;
+            Connection* conn;
+            // Encodings it reads, one bit per ChunkEncoding
+            uint32_t encodings = 1u << ChunkEncoding::Raw;
+            // Chunks it was sent and has not forgotten, it gets their edits
+            std::set< std::pair<int, int> > sent;
+            DeltaBatch edits;
+            ~Client(){ delete conn; }
+        };
+
+        // waiting holds the ids of clients that asked while it was generating,
+        // edits the edits made meanwhile as block index and id, and payloads
+        // the chunk in each encoding sent so far
+        struct Entry{
+            Chunk* chunk;
+            std::vector<int> waiting;
+            std::vector< std::pair<unsigned int, unsigned int> > edits;
+            std::vector<unsigned char> payloads[ChunkEncoding::Count];
+            std::list< std::pair<int, int> >::iterator lruPosition;
+        };
+
+        RegionStore* store;
+        ChunkIO* io;
+        WorkerPool* workers;
+
+        int listenFd = -1;
+        std::string unixPath;
+        int wakePipe[2] = { -1, -1 };
+
+        std::map<int, Client*> clients;
+        int nextClientId = 0;
+
+        std::map< std::pair<int, int>, Entry > chunks;
+        // Generated chunks, front was served most recently
+        std::list< std::pair<int, int> > lru;
+        size_t cachedBytes = 0;
+
+        std::mutex finishedLock;
+        std::vector<Chunk*> finished;
+
+        void Accept(){
+            while (true){
+                int fd = accept(listenFd, nullptr, nullptr);
+                if (fd == -1) { return; }
+                NetAddress::NoDelay(fd);
+                Client* client = new Client();
+                client->id = nextClientId++;
+                client->conn = new Connection(fd);
+                clients[client->id] = client;
+                stats.clientsAccepted++;
+            }
+        }
+
+        // Chunks it was waiting on keep generating for the cache
+        void Disconnect(Client* client){
+            clients.erase(client->id);
+            delete client;
+        }
+
+        void Handle(Client* client, const Message& message){
+            if (message.type == MessageType::ChunkRequest && message.body.size() == 8){
+                int32_t coords[2];
+                std::memcpy(coords, message.body.data(), 8);
+                Request(client, coords[0], coords[1]);
+            } else if (message.type == MessageType::Hello && message.body.size() == 4){
+                std::memcpy(&client->encodings, message.body.data(), 4);
+            } else if (message.type == MessageType::ChunkForget && message.body.size() == 8){
+                int32_t coords[2];
+                std::memcpy(coords, message.body.data(), 8);
+                stats.forgotten += client->sent.erase(std::pair<int, int>(coords[0], coords[1]));
+            } else if (message.type == MessageType::BlockDeltas){
+                bool valid = DeltaBatch::Decode(message.body.data(), message.body.size(), [this, client](int x, int z, unsigned int index, unsigned int block){
+                    Edit(client, x, z, index, block);
+                });
+                if (!valid) { std::cout << "ERROR::SERVER::BAD_DELTAS from client " << client->id << std::endl; }
+            }
+        }
+
+        void Request(Client* client, int x, int z){
+            stats.requests++;
+            telemetry->Count(PipelineEvent::Requested);
+            std::pair<int, int> key(x, z);
+
+            std::map< std::pair<int, int>, Entry >::iterator it = chunks.find(key);
+            if (it != chunks.end()){
+                Entry& entry = it->second;
+                if (entry.chunk->chunkState == 2){
+                    stats.cacheHits++;
+                    lru.splice(lru.begin(), lru, entry.lruPosition);
+                    Send(client, entry);
+                } else {
+                    stats.shared++;
+                    entry.waiting.push_back(client->id);
+                }
+                return;
+            }
+
+            Start(key).waiting.push_back(client->id);
+        }
+
+        // Applies a client's edit and queues it for everyone else holding the
+        // chunk. A chunk that is not cached is generated or loaded first.
+        void Edit(Client* from, int x, int z, unsigned int index, unsigned int block){
+            if (index >= (unsigned int)(chunkXSize * chunkYSize * chunkZSize)) { return; }
+            stats.editsReceived++;
+            std::pair<int, int> key(x, z);
+
+            std::map< std::pair<int, int>, Entry >::iterator it = chunks.find(key);
+            Entry& entry = it != chunks.end() ? it->second : Start(key);
+            if (entry.chunk->chunkState == 2){
+                glm::ivec3 local = entry.chunk->BlockPosition(index);
+                entry.chunk->SetAt(local.x, local.y, local.z, block);
+                DropPayloads(entry);
+            } else {
+                entry.edits.push_back(std::make_pair(index, block));
+            }
+
+            for (std::map<int, Client*>::iterator c = clients.begin(); c != clients.end(); c++){
+                Client* client = c->second;
+                if (client == from || client->sent.count(key) == 0) { continue; }
+                client->edits.Add(x, z, index, block);
+                stats.editsForwarded++;
+            }
+        }
+
+        // Creates the chunk and queues its generation
+        Entry& Start(std::pair<int, int> key){
+            int x = key.first, z = key.second;
+            Chunk* ch = new Chunk(x, z, chunkXSize, chunkYSize, chunkZSize);
+            ch->io = io;
+            ch->storedOnDisk = io->Contains(x, z);
+            ch->ClaimGeneration();
+            ch->timeline.requested = PipelineTelemetry::Now();
+            ch->timeline.queued = ch->timeline.requested;
+
+            Entry& entry = chunks[key];
+            entry.chunk = ch;
+            entry.lruPosition = lru.end();
+
+            workers->Submit([this, ch]{
+                ch->timeline.generationStarted = PipelineTelemetry::Now();
+                ch->GenerateBlocks();
+                ch->timeline.generated = PipelineTelemetry::Now();
+                ch->chunkState = 2;
+                {
+                    std::lock_guard<std::mutex> guard(finishedLock);
+                    finished.push_back(ch);
+                }
+                char wake = 1;
+                if (write(wakePipe[1], &wake, 1) < 0) {} // Full means poll is already woken
+            });
+            return entry;
+        }
+
+        void CollectFinished(){
+            char drain[256];
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0) {}
+
+            std::vector<Chunk*> done;
+            {
+                std::lock_guard<std::mutex> guard(finishedLock);
+                done.swap(finished);
+            }
+
+            for (size_t i = 0; i < done.size(); i++){
+                Chunk* ch = done[i];
+                telemetry->Record(PipelineStage::QueueWait, ch->timeline.queued, ch->timeline.generationStarted);
+                telemetry->Record(PipelineStage::Generation, ch->timeline.generationStarted, ch->timeline.generated);
+                stats.generated++;
+
+                Entry& entry = chunks[std::pair<int, int>(ch->xCoord, ch->zCoord)];
+                for (size_t e = 0; e < entry.edits.size(); e++){
+                    glm::ivec3 local = ch->BlockPosition(entry.edits[e].first);
+                    ch->SetAt(local.x, local.y, local.z, entry.edits[e].second);
+                }
+                entry.edits.clear();
+
+                for (size_t w = 0; w < entry.waiting.size(); w++){
+                    std::map<int, Client*>::iterator client = clients.find(entry.waiting[w]);
+                    if (client != clients.end()) { Send(client->second, entry); }
+                }
+                entry.waiting.clear();
+                lru.push_front(std::pair<int, int>(ch->xCoord, ch->zCoord));
+                entry.lruPosition = lru.begin();
+                cachedBytes += ch->CpuBytes();
+            }
+        }
+
+        void Send(Client* client, Entry& entry){
+            Chunk* ch = entry.chunk;
+            uint32_t encoding = ChunkCodec::Best(client->encodings);
+            const std::vector<unsigned char>* encoded = Encoded(entry, encoding);
+            if (encoding != ChunkEncoding::Raw && encoded == nullptr){
+                // Packed needs no library, a client that does not read it gets the raw blocks
+                std::cout << "ERROR::SERVER::ENCODE_FAILED " << chunkEncodingNames[encoding] << " " << ch->xCoord << " " << ch->zCoord << std::endl;
+                encoding = encoding != ChunkEncoding::Packed && (client->encodings & (1u << ChunkEncoding::Packed)) ? ChunkEncoding::Packed : ChunkEncoding::Raw;
+                encoded = Encoded(entry, encoding);
+                if (encoded == nullptr) { encoding = ChunkEncoding::Raw; }
+            }
+
+            const void* payload = encoded != nullptr ? (const void*)encoded->data() : (const void*)ch->BlockData();
+            size_t length = encoded != nullptr ? encoded->size() : ch->BlockBytes();
+
+            int32_t header[3] = { ch->xCoord, ch->zCoord, (int32_t)encoding };
+            client->conn->Send(MessageType::ChunkData, header, sizeof(header), payload, length);
+            client->sent.insert(std::pair<int, int>(ch->xCoord, ch->zCoord));
+            stats.served++;
+            stats.bytesSent += Connection::headerSize + sizeof(header) + length;
+        }
+
+        // The chunk in an encoding other than Raw, encoded on first use and
+        // kept with the entry. Null for Raw or when encoding fails.
+        const std::vector<unsigned char>* Encoded(Entry& entry, uint32_t encoding){
+            if (encoding == ChunkEncoding::Raw) { return nullptr; }
+            std::vector<unsigned char>& encoded = entry.payloads[encoding];
+            if (encoded.empty()){
+                if (!ChunkCodec::Encode(entry.chunk->BlockData(), chunkXSize * chunkYSize * chunkZSize, encoding, encoded)){
+                    encoded.clear();
+                    return nullptr;
+                }
+                cachedBytes += encoded.size();
+            }
+            return &encoded;
+        }
+
+        void DropPayloads(Entry& entry){
+            for (uint32_t e = 0; e < ChunkEncoding::Count; e++){
+                cachedBytes -= entry.payloads[e].size();
+                std::vector<unsigned char>().swap(entry.payloads[e]);
+            }
+        }
+
+        // Edited chunks are written back like the game does on unload
+        void Unload(Chunk* ch){
+            if (ch->modified && ch->chunkState == 2){
+                unsigned int* data = ch->ReleaseData();
+                if (data != nullptr) { io->Enqueue(ch->xCoord, ch->zCoord, data); }
+            }
+            delete ch;
+        }
+
+        // Drops the least recently served chunks once over budget
+        void Trim(){
+            while (cachedBytes > memoryBudget && !lru.empty()){
+                std::map< std::pair<int, int>, Entry >::iterator it = chunks.find(lru.back());
+                lru.pop_back();
+                DropPayloads(it->second);
+                cachedBytes -= it->second.chunk->CpuBytes();
+                Unload(it->second.chunk);
+                chunks.erase(it);
+                stats.evictions++;
+            }
+        }
+};
+
+#endif
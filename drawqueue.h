@@ -0,0 +1,74 @@
+#ifndef DRAWQUEUE_H
+#define DRAWQUEUE_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "chunk.h"
+
+// Chunks waiting to be drawn this frame, ordered by distance from the camera.
+// Opaque geometry is drawn front to back so early depth testing rejects the
+// hidden fragments, translucent geometry needs the reverse. Distances are
+// quantized to 16 bits and sorted with a two pass LSD radix sort. The entry
+// and sort buffers persist between frames, so once they have grown to fit
+// the view no allocation happens.
+class DrawQueue{
+    public:
+        struct Entry{
+            Chunk* chunk;
+            unsigned int sections;
+            uint16_t key;
+        };
+
+        std::vector<Entry> entries;
+
+        // Distances beyond this all share the largest key
+        float maxDistance = 1.0f;
+
+        void Clear(){ entries.clear(); }
+
+        void Add(Chunk* chunk, unsigned int sections, float distance){
+            float scaled = distance / maxDistance * 65535.0f;
+            uint16_t key = (uint16_t)std::min(65535.0f, std::max(0.0f, scaled));
+            entries.push_back(Entry{ chunk, sections, key });
+        }
+
+        void SortFrontToBack(){ Sort(false); }
+
+        void SortBackToFront(){ Sort(true); }
+
+    private:
+        std::vector<Entry> scratch;
+
+        void Sort(bool reverse){
+            size_t count = entries.size();
+            if (count < 2) { return; }
+            if (scratch.size() < count) { scratch.resize(count); }
+
+            Entry* src = entries.data();
+            Entry* dst = scratch.data();
+            for (int shift = 0; shift < 16; shift += 8){
+                size_t offsets[256] = {};
+                for (size_t i = 0; i < count; i++) { offsets[Digit(src[i], shift, reverse)]++; }
+
+                size_t total = 0;
+                for (int d = 0; d < 256; d++){
+                    size_t n = offsets[d];
+                    offsets[d] = total;
+                    total += n;
+                }
+
+                for (size_t i = 0; i < count; i++) { dst[offsets[Digit(src[i], shift, reverse)]++] = src[i]; }
+                std::swap(src, dst);
+            }
+            // Two passes leave the result back in entries
+        }
+
+        static int Digit(const Entry& e, int shift, bool reverse){
+            uint16_t key = reverse ? (uint16_t)(65535 - e.key) : e.key;
+            return (key >> shift) & 0xFF;
+        }
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <deque>
+#include <functional>
+
+#include "chunk.h"
+#include "glm/glm.hpp"
+
+// Incremental light updates after block edits. Works in world block
+// coordinates so the flood fill crosses chunk borders freely. Each channel
+// (sky and block light) uses the usual pair of queues: a removal pass clears
+// light that depended on the changed block, then an add pass refills from the
+// brightest cells bordering the cleared area. Only voxels whose light actually
+// changes are touched, and their sections are reported through onChanged so
+// they get remeshed.
+//
+// Chunks that are missing or still generating act as opaque walls.
+class LightEngine{
+    public:
+        std::function<Chunk*(int, int)> findChunk;
+        std::function<void(Chunk*, glm::ivec3)> onChanged;
+
+        LightEngine(int cXS, int cYS, int cZS){
+            chunkXSize = cXS; chunkYSize = cYS; chunkZSize = cZS;
+        }
+
+        void OnBlockChanged(glm::ivec3 pos, unsigned int oldBlock, unsigned int newBlock){
+            cached = nullptr; // Chunks may have been unloaded since the last edit
+
+            for (int channel = 0; channel < 2; channel++){
+                bool sky = channel == 0;
+
+                // Light the old block gave off, or more than the new one gives,
+                // came from this cell and has to be taken back first
+                if (!sky){
+                    unsigned char stored = GetLight(pos, false);
+                    if (stored > 0 && (BlockRegistry::Emission(oldBlock) > 0 || stored > BlockRegistry::Emission(newBlock))){
+                        SetLight(pos, false, 0);
+                        removeQueue.push_back(LightNode{pos, stored});
+                    }
+                }
+
+                if (BlockRegistry::Opaque(newBlock)){
+                    unsigned char old = GetLight(pos, sky);
+                    if (old > 0){
+                        SetLight(pos, sky, 0);
+                        removeQueue.push_back(LightNode{pos, old});
+                    }
+                } else {
+                    // Let the neighbours flow into the newly opened cell
+                    for (int d = 0; d < 6; d++){
+                        glm::ivec3 n = pos + directions[d];
+                        if (GetLight(n, sky) > 0) { addQueue.push_back(n); }
+                    }
+                }
+
+                unsigned char emission = sky ? 0 : BlockRegistry::Emission(newBlock);
+                if (emission > 0){
+                    SetLight(pos, sky, emission);
+                    addQueue.push_back(pos);
+                }
+
+                Propagate(sky);
+            }
+        }
+
+    private:
+        struct LightNode{
+            glm::ivec3 pos;
+            unsigned char level;
+        };
+
+        int chunkXSize, chunkYSize, chunkZSize;
+
+        std::deque<LightNode> removeQueue;
+        std::deque<glm::ivec3> addQueue;
+
+        // Lookup cache, most steps of a flood fill stay inside one chunk
+        Chunk* cached = nullptr;
+        int cachedX = 0, cachedZ = 0;
+
+        const glm::ivec3 directions[6] = {
+            glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0),
+            glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0),
+            glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)
+        };
+
+        static int FloorDiv(int a, int b){
+            return a >= 0 ? a / b : (a - b + 1) / b;
+        }
+
+        // Resolves a world position to a generated chunk and local coordinates
+        Chunk* Locate(glm::ivec3 pos, glm::ivec3& local){
+            if (pos.y < 0 || pos.y >= chunkYSize) { return nullptr; }
+
+            int cx = FloorDiv(pos.x, chunkXSize), cz = FloorDiv(pos.z, chunkZSize);
+            if (cached == nullptr || cx != cachedX || cz != cachedZ){
+                cached = findChunk(cx, cz);
+                cachedX = cx; cachedZ = cz;
+            }
+            if (cached == nullptr || cached->chunkState < 2 || cached->chunkState == 4) { return nullptr; }
+
+            local = glm::ivec3(pos.x - cx * chunkXSize, pos.y, pos.z - cz * chunkZSize);
+            return cached;
+        }
+
+        // Above the world is open sky, everything else outside loaded chunks is dark
+        unsigned char GetLight(glm::ivec3 pos, bool sky){
+            if (pos.y >= chunkYSize) { return sky ? 15 : 0; }
+            glm::ivec3 local;
+            Chunk* ch = Locate(pos, local);
+            if (ch == nullptr) { return 0; }
+            return sky ? ch->GetSkyLight(local.x, local.y, local.z) : ch->GetBlockLight(local.x, local.y, local.z);
+        }
+
+        void SetLight(glm::ivec3 pos, bool sky, unsigned char level){
+            glm::ivec3 local;
+            Chunk* ch = Locate(pos, local);
+            if (ch == nullptr) { return; }
+
+            if (sky) { ch->SetSkyLight(local.x, local.y, local.z, level); }
+            else { ch->SetBlockLight(local.x, local.y, local.z, level); }
+            onChanged(ch, local);
+        }
+
+        bool IsOpen(glm::ivec3 pos){
+            glm::ivec3 local;
+            Chunk* ch = Locate(pos, local);
+            return ch != nullptr && !BlockRegistry::Opaque(ch->GetAt(local.x, local.y, local.z));
+        }
+
+        void Propagate(bool sky){
+            while (!removeQueue.empty()){
+                LightNode node = removeQueue.front();
+                removeQueue.pop_front();
+
+                for (int d = 0; d < 6; d++){
+                    glm::ivec3 n = node.pos + directions[d];
+                    unsigned char level = GetLight(n, sky);
+                    if (level == 0 || n.y >= chunkYSize) { continue; }
+
+                    // Full skylight travels straight down, so it depended on us too
+                    bool fed = level < node.level || (sky && d == 3 && node.level == 15 && level == 15);
+                    if (fed){
+                        SetLight(n, sky, 0);
+                        removeQueue.push_back(LightNode{n, level});
+                    } else {
+                        addQueue.push_back(n);
+                    }
+                }
+            }
+
+            while (!addQueue.empty()){
+                glm::ivec3 pos = addQueue.front();
+                addQueue.pop_front();
+
+                unsigned char level = GetLight(pos, sky);
+                if (level <= 1) { continue; }
+
+                for (int d = 0; d < 6; d++){
+                    glm::ivec3 n = pos + directions[d];
+                    if (!IsOpen(n)) { continue; }
+
+                    unsigned char target = (sky && d == 3 && level == 15) ? 15 : level - 1;
+                    if (GetLight(n, sky) < target){
+                        SetLight(n, sky, target);
+                        addQueue.push_back(n);
+                    }
+                }
+            }
+        }
+};
+
+#endif
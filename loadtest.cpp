@@ -0,0 +1,177 @@
+// Load generator for Server.exe. Forks stand-in clients that each fly through
+// the world like runHeadless does, requesting every column that comes into
+// range, and reports how fast the server kept up. Built by "make loadtest":
+//
+//     ./LoadTest.exe [--server unix:blockgame.sock] [--clients n] [--seconds s] [--distance chunks] [--spread chunks]
+//                    [--raw] [--edits n]
+//
+// Clients start spread chunks apart along z, so 0 has them all share one path
+// and a large spread has them share nothing. They take the smallest chunk
+// encoding the build has unless --raw is given, and decode every chunk. With
+// --edits each client also changes n blocks per tick in chunks it holds.
+
+#include "netprotocol.h"
+#include "telemetry.h"
+
+#include <set>
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+const double tickLength = 1.0 / 20.0;
+const float blocksPerSecond = 50.0f;
+const int chunkSize = 16;
+const size_t voxelsPerChunk = 16 * 32 * 16;
+
+struct ClientResult{
+    size_t requested, received, bytes;
+    size_t editsSent, editsReceived;
+    double p50, p95, p99, max;
+};
+
+double now(){ return PipelineTelemetry::Now(); }
+
+ClientResult runClient(const std::string& address, int index, double seconds, int distance, int spread, bool raw, int edits){
+    ClientResult result = {};
+    int fd = NetAddress::Connect(address);
+    if (fd == -1) { return result; }
+    Connection conn(fd);
+    uint32_t encodings = raw ? 1u << ChunkEncoding::Raw : ChunkCodec::Supported();
+    conn.Send(MessageType::Hello, &encodings, sizeof(encodings));
+
+    LatencyHistogram latency;
+    std::map< std::pair<int, int>, double > sentAt;
+    std::set< std::pair<int, int> > requested;
+    std::vector< std::pair<int, int> > held;
+    std::vector<unsigned int> blocks(voxelsPerChunk);
+    unsigned int random = 2463534242u + index;
+
+    int zCoord = index * spread;
+    double start = now(), nextTick = start;
+    while (now() - start < seconds && conn.Open()){
+        if (now() >= nextTick){
+            int xCoord = (int)((now() - start) * blocksPerSecond / chunkSize);
+            for (int z = zCoord - distance; z <= zCoord + distance; z++){
+                for (int x = xCoord - distance; x <= xCoord + distance; x++){
+                    std::pair<int, int> key(x, z);
+                    if (!requested.insert(key).second) { continue; }
+                    int32_t coords[2] = { x, z };
+                    conn.Send(MessageType::ChunkRequest, coords, sizeof(coords));
+                    sentAt[key] = now();
+                    result.requested++;
+                }
+            }
+
+            DeltaBatch batch;
+            for (int e = 0; e < edits && !held.empty(); e++){
+                random ^= random << 13; random ^= random >> 17; random ^= random << 5;
+                const std::pair<int, int>& chunk = held[random % held.size()];
+                batch.Add(chunk.first, chunk.second, (random >> 8) % voxelsPerChunk, random % 4);
+            }
+            if (!batch.Empty()){
+                std::vector<unsigned char> body;
+                batch.Encode(body);
+                conn.Send(MessageType::BlockDeltas, body.data(), body.size());
+                result.editsSent += batch.Edits();
+            }
+            nextTick += tickLength;
+        }
+        conn.Flush();
+
+        pollfd p = { conn.fd, (short)(POLLIN | (conn.WantsWrite() ? POLLOUT : 0)), 0 };
+        poll(&p, 1, 5);
+        conn.Receive();
+
+        Message message;
+        while (conn.Next(message)){
+            result.bytes += Connection::headerSize + message.body.size();
+            if (message.type == MessageType::BlockDeltas){
+                DeltaBatch::Decode(message.body.data(), message.body.size(), [&](int, int, unsigned int, unsigned int){ result.editsReceived++; });
+                continue;
+            }
+            if (message.type != MessageType::ChunkData || message.body.size() < 12) { continue; }
+            int32_t fields[3];
+            std::memcpy(fields, message.body.data(), 12);
+            std::map< std::pair<int, int>, double >::iterator it = sentAt.find(std::pair<int, int>(fields[0], fields[1]));
+            if (it == sentAt.end()) { continue; }
+            if (!ChunkCodec::Decode(message.body.data() + 12, message.body.size() - 12, (uint32_t)fields[2], blocks.data(), voxelsPerChunk)){
+                std::cout << "ERROR::LOADTEST::BAD_CHUNK " << fields[0] << " " << fields[1] << std::endl;
+            }
+            latency.Add(now() - it->second);
+            held.push_back(it->first);
+            sentAt.erase(it);
+            result.received++;
+        }
+    }
+
+    result.p50 = latency.PercentileSeconds(0.50);
+    result.p95 = latency.PercentileSeconds(0.95);
+    result.p99 = latency.PercentileSeconds(0.99);
+    result.max = latency.MaxSeconds();
+    return result;
+}
+
+int main(int argc, char** argv){
+    std::string address = "unix:blockgame.sock";
+    int clients = 4, distance = 8, spread = 4, edits = 0;
+    double seconds = 20.0;
+    bool raw = false;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "--server") == 0 && i + 1 < argc) { address = argv[++i]; }
+        else if (std::strcmp(argv[i], "--clients") == 0 && i + 1 < argc) { clients = std::max(1, std::atoi(argv[++i])); }
+        else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) { seconds = std::atof(argv[++i]); }
+        else if (std::strcmp(argv[i], "--distance") == 0 && i + 1 < argc) { distance = std::atoi(argv[++i]); }
+        else if (std::strcmp(argv[i], "--spread") == 0 && i + 1 < argc) { spread = std::atoi(argv[++i]); }
+        else if (std::strcmp(argv[i], "--edits") == 0 && i + 1 < argc) { edits = std::atoi(argv[++i]); }
+        else if (std::strcmp(argv[i], "--raw") == 0) { raw = true; }
+    }
+
+    // Each client writes one fixed size result back through the pipe
+    int results[2];
+    if (pipe(results) != 0) { std::cout << "ERROR::LOADTEST::PIPE_FAILED" << std::endl; return 1; }
+
+    for (int c = 0; c < clients; c++){
+        pid_t pid = fork();
+        if (pid == 0){
+            close(results[0]);
+            ClientResult result = runClient(address, c, seconds, distance, spread, raw, edits);
+            ssize_t written = write(results[1], &result, sizeof(result));
+            _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+        }
+        if (pid < 0) { std::cout << "ERROR::LOADTEST::FORK_FAILED" << std::endl; clients = c; break; }
+    }
+    close(results[1]);
+
+    ClientResult total = {};
+    int reported = 0;
+    ClientResult result;
+    while (read(results[0], &result, sizeof(result)) == (ssize_t)sizeof(result)){
+        std::printf("client %d: requested %zu, received %zu, latency p50/p95/p99/max %.1f/%.1f/%.1f/%.1f ms\n", reported,
+                    result.requested, result.received, result.p50 * 1000.0, result.p95 * 1000.0, result.p99 * 1000.0, result.max * 1000.0);
+        total.requested += result.requested;
+        total.received += result.received;
+        total.bytes += result.bytes;
+        total.editsSent += result.editsSent;
+        total.editsReceived += result.editsReceived;
+        total.p50 = std::max(total.p50, result.p50);
+        total.p99 = std::max(total.p99, result.p99);
+        reported++;
+    }
+    while (wait(nullptr) > 0) {}
+
+    std::printf("%d clients for %.0f s: %zu chunks received of %zu requested, %.1f chunks/s, %.1f MB/s, worst client p50 %.1f ms p99 %.1f ms\n",
+                reported, seconds, total.received, total.requested, total.received / seconds,
+                total.bytes / seconds / (1024.0 * 1024.0), total.p50 * 1000.0, total.p99 * 1000.0);
+    if (edits > 0) { std::printf("edits sent %zu, edits received from other clients %zu\n", total.editsSent, total.editsReceived); }
+    return reported == clients ? 0 : 1;
+}
@@ -9,19 +9,32 @@
 
 #include "shader.h"
 #include "world.h"
+#include "renderer.h"
 #include "chunk.h"
 #include "camera.h"
+#include "textures.h"
+#include "memstats.h"
 
 #include "PerlinNoise.hpp"
 
 #include <iostream>
 #include <vector>
 #include <ctime>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <fstream>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
+int runHeadless(int tickCount, bool realtime, const char* memoryCsv);
+void writeTelemetry();
 
 const unsigned int SCR_WIDTH = 1600;
 const unsigned int SCR_HEIGHT = 1200;
@@ -34,11 +47,55 @@ Camera* camera = new Camera(glm::vec3(8.0f, 8.0f,  8.0f), // Position
 
 World* world = new World(16);
 
+// The simulation advances in fixed ticks, rendering runs as fast as it can
+// and interpolates the camera between the last two ticks
+const double tickRate = 20.0;
+const double tickLength = 1.0 / tickRate;
+// A frame this far behind drops the extra ticks rather than spiralling
+const int maxTicksPerFrame = 5;
+
 float deltaTime = 0.0f;	// Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
+double tickAccumulator = 0.0;
+float lastTitleUpdate = 0.0f;
+size_t lastColumnsInView = 0, lastColumnsNotReady = 0;
+// F3 swaps the title between render stats and memory use
+bool memoryOverlay = false;
+// F5 draws the world as wireframe, for looking at the meshes
+bool wireframe = false;
+// Left clicks since the last tick, applied by the next one
+int queuedBreaks = 0;
+// Chunk pipeline latencies are written here on exit and on F4, .json or .csv
+std::string telemetryPath = "telemetry.json";
+bool firstFrame = true;
 
-int main()
+int main(int argc, char** argv)
 {
+    // --no-shader-cache compiles the shaders from source even when a cached binary exists
+    bool shaderCache = true;
+    // --headless [ticks] runs the simulation without a window as fast as possible,
+    // add --realtime to pace the ticks at tickRate instead
+    bool headless = false, realtime = false;
+    int headlessTicks = 1200;
+    // --memory-csv <file> writes the memory accounting once a second of ticks in headless mode
+    const char* memoryCsv = nullptr;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "--no-shader-cache") == 0) { shaderCache = false; }
+        else if (std::strcmp(argv[i], "--headless") == 0){
+            headless = true;
+            if (i + 1 < argc && std::atoi(argv[i + 1]) > 0) { headlessTicks = std::atoi(argv[++i]); }
+        }
+        else if (std::strcmp(argv[i], "--realtime") == 0) { realtime = true; }
+        else if (std::strcmp(argv[i], "--memory-csv") == 0 && i + 1 < argc) { memoryCsv = argv[++i]; }
+        else if (std::strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) { telemetryPath = argv[++i]; }
+        else if (std::strcmp(argv[i], "--no-prefetch") == 0) { world->prefetchEnabled = false; }
+        // --server <address> streams chunks from Server.exe, unix:<path> or host:port
+        else if (std::strcmp(argv[i], "--server") == 0 && i + 1 < argc){
+            if (world->ConnectToServer(argv[++i])) { std::cout << "Streaming chunks from " << argv[i] << std::endl; }
+        }
+    }
+    if (headless) { return runHeadless(headlessTicks, realtime, memoryCsv); }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -58,6 +115,8 @@ int main()
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -67,39 +126,96 @@ int main()
     }
 
     glEnable(GL_DEPTH_TEST);
-    //glEnable(GL_CULL_FACE);
+    glEnable(GL_CULL_FACE);
 
-    glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
+    // Decoded on a worker, a white placeholder is bound until then
+    TextureArray* textures = new TextureArray();
+    textures->StartLoading(world->workers, "Textures");
 
-    Shader ourShader("Shaders/projection.vs", "Shaders/projection.fs");
+    Shader ourShader("Shaders/projection.vs", "Shaders/projection.fs", shaderCache ? "ShaderCache" : nullptr);
  
     ourShader.use(); 
+    ourShader.setInt("blockTextures", 0);
 
     glm::mat4 projection = camera->GetPerspectiveMatrix(SCR_WIDTH, SCR_HEIGHT);
     ourShader.setMat4("projection", projection);
 
+    WorldRenderer* renderer = new WorldRenderer(world);
+
     while (!glfwWindowShouldClose(window))
     {
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        processInput(window);
+        tickAccumulator += deltaTime;
+        int ticksThisFrame = 0;
+        while (tickAccumulator >= tickLength){
+            if (ticksThisFrame == maxTicksPerFrame) { tickAccumulator = 0.0; break; }
+            camera->BeginTick();
+            processInput(window);
+            world->Tick(camera->position);
+            tickAccumulator -= tickLength;
+            ticksThisFrame++;
+        }
+
+        // Mouse look is applied straight away, only the position is interpolated
+        Camera view = *camera;
+        view.position = camera->InterpolatedPosition((float)(tickAccumulator / tickLength));
 
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         ourShader.use();
+        textures->Upload();
+        textures->Bind(0);
 
-        glm::mat4 view = camera->GetViewMatrix();
-        ourShader.setMat4("view", view);
+        glm::mat4 viewMatrix = view.GetViewMatrix();
+        ourShader.setMat4("view", viewMatrix);
 
-        world->Draw(ourShader, camera);
+        renderer->Draw(ourShader, &view, projection * viewMatrix);
+
+        // Cull rate of the last frame in the title, refreshed once a second
+        if (currentFrame - lastTitleUpdate >= 1.0f){
+            OcclusionCuller::Stats cull = renderer->occlusion->stats;
+            std::string title = "BlockGame | sections tested " + std::to_string(cull.tested) +
+                                " frustum culled " + std::to_string(cull.frustumCulled) +
+                                " occluded " + std::to_string(cull.occluded) +
+                                " (" + std::to_string((int)(renderer->occlusion->CullRate() * 100.0f)) + "%)";
+
+            // Share of visible columns drawn before they were ready over the last second
+            size_t inView = world->columnsInView - lastColumnsInView;
+            size_t notReady = world->columnsNotReady - lastColumnsNotReady;
+            title += " | not ready " + std::to_string(inView > 0 ? (int)(notReady * 100 / inView) : 0) + "%";
+            title += " | cache hit " + std::to_string((int)(world->cache->HitRate() * 100.0f)) + "%";
+            lastColumnsInView = world->columnsInView;
+            lastColumnsNotReady = world->columnsNotReady;
+
+            if (memoryOverlay){
+                title = "BlockGame | MB " + MemoryStats::Summary() + " | cache " + MemoryStats::Megabytes(world->cache->Bytes()) +
+                        " of " + MemoryStats::Megabytes(world->cache->memoryBudget) + " MB";
+            }
+
+            glfwSetWindowTitle(window, title.c_str());
+            lastTitleUpdate = currentFrame;
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        // Startup cost, glfwGetTime counts from glfwInit
+        if (firstFrame){
+            std::cout << "Time to first frame " << glfwGetTime() * 1000.0 << " ms, shader "
+                      << (ourShader.fromCache ? "loaded from cache" : "compiled from source") << std::endl;
+            firstFrame = false;
+        }
     }
 
+    writeTelemetry();
+    delete renderer;
+    delete world;
+    delete textures;
+
     glfwTerminate();
     return 0;
 }
@@ -112,8 +228,109 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     camera->ProcessScrollCallback(window, xoffset, yoffset);
 }
 
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS){
+        queuedBreaks++;
+    }
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods){
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS){
+        memoryOverlay = !memoryOverlay;
+        lastTitleUpdate = 0.0f;
+    }
+    if (key == GLFW_KEY_F4 && action == GLFW_PRESS){
+        writeTelemetry();
+    }
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS){
+        wireframe = !wireframe;
+        glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
+    }
+}
+
+void writeTelemetry(){
+    if (world->telemetry->Write(telemetryPath)) { std::cout << "Chunk pipeline telemetry written to " << telemetryPath << std::endl; }
+}
+
+// Called once per tick, so movement is in steps of tickLength. Clicks are
+// applied here rather than in the callback, so edits, relighting and the
+// edits sent to a server all happen on tick boundaries.
 void processInput(GLFWwindow *window){
-    camera->ProcessInput(window, deltaTime);
+    camera->ProcessInput(window, (float)tickLength);
+    for (; queuedBreaks > 0; queuedBreaks--) { world->DestroyBlock(camera->position, camera->forward, 8.0f); }
+}
+
+// Throughput benchmark, ticks back to back with the camera flying in a
+// straight line at sprint speed so new chunks keep coming into range
+int runHeadless(int tickCount, bool realtime, const char* memoryCsv){
+    std::ofstream csv;
+    if (memoryCsv != nullptr){
+        csv.open(memoryCsv);
+        if (!csv) { std::cout << "ERROR::HEADLESS::CSV_NOT_OPENED " << memoryCsv << std::endl; }
+        else { csv << MemoryStats::CsvHeader() << "\n"; }
+    }
+
+    glm::vec3 velocity = glm::vec3(50.0f, 0.0f, 0.0f);
+    camera->forward = glm::normalize(velocity);
+    glm::mat4 projection = camera->GetPerspectiveMatrix(SCR_WIDTH, SCR_HEIGHT);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < tickCount; i++){
+        if (realtime) { std::this_thread::sleep_until(start + std::chrono::duration<double>(i * tickLength)); }
+        camera->BeginTick();
+        camera->position += velocity * (float)tickLength;
+        world->Tick(camera->position);
+        world->CountReadiness(projection * camera->GetViewMatrix(), camera->position);
+
+        // Game time rather than wall time, so runs at different speeds line up
+        if ((i + 1) % (int)tickRate == 0 && csv.is_open()) { csv << MemoryStats::CsvRow((i + 1) * tickLength) << std::endl; }
+        if ((i + 1) % (int)(tickRate * 10) == 0) { std::cout << "Memory at tick " << i + 1 << " MB " << MemoryStats::Summary() << std::endl; }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t generated = 0;
+    for (std::map< std::pair<int, int>, Chunk* >::iterator iter = world->chunkMap.begin(); iter != world->chunkMap.end(); iter++){
+        if (iter->second->chunkState == 2) { generated++; }
+    }
+
+    std::cout << "Headless " << tickCount << " ticks in " << seconds * 1000.0 << " ms, "
+              << tickCount / seconds << " ticks/s, " << seconds * 1000.0 / tickCount << " ms/tick" << std::endl;
+    std::cout << "Generations started " << world->generationsStarted << ", generated and loaded " << generated
+              << ", loaded chunks " << world->chunkMap.size() << std::endl;
+    std::cout << "Prefetches started " << world->prefetchesStarted << ", visible columns not ready "
+              << world->columnsNotReady << " of " << world->columnsInView << " ("
+              << (world->columnsInView > 0 ? 100.0 * world->columnsNotReady / world->columnsInView : 0.0) << "%)" << std::endl;
+    std::cout << "Random ticks " << world->ticker->sectionsTicked << " sections, " << world->tickedSections << " of "
+              << world->generatedSections << " generated sections tickable at the end, " << world->ticker->changesMade << " blocks changed, "
+              << world->randomTickSeconds * 1000.0 / tickCount << " ms/tick" << std::endl;
+    if (world->remote != nullptr){
+        std::cout << "Server requests " << world->remote->stats.requested << ", received " << world->remote->stats.received
+                  << ", " << world->remote->stats.bytesReceived / 1024 << " KB, edits sent " << world->remote->stats.editsSent
+                  << ", edits received " << world->remote->stats.editsReceived << std::endl;
+    }
+    std::cout << "Pipeline p50/p95/p99 " << world->telemetry->Summary(PipelineStage::QueueWait) << ", "
+              << world->telemetry->Summary(PipelineStage::Generation) << ", " << world->telemetry->Summary(PipelineStage::Meshing) << ", "
+              << world->telemetry->Summary(PipelineStage::RequestToMeshed) << ", meshed "
+              << world->telemetry->Throughput(PipelineEvent::Meshed) << " chunks/s" << std::endl;
+    ChunkCache::Stats cacheStats = world->cache->stats;
+    std::cout << "Cache " << world->cache->Count() << " chunks, " << world->cache->Bytes() / (1024 * 1024) << " MB, hits "
+              << cacheStats.hits + cacheStats.reuploads << " (" << cacheStats.reuploads << " needing upload), misses " << cacheStats.misses
+              << ", buffers released " << cacheStats.gpuReleases << ", evicted " << cacheStats.evictions
+              << ", hit rate " << world->cache->HitRate() * 100.0f << "%" << std::endl;
+
+    writeTelemetry();
+    delete world;
+    world = nullptr;
+
+    // Everything should be back to zero, what is left leaked
+    std::cout << "Memory after shutdown MB " << MemoryStats::Summary() << std::endl;
+    for (int t = 0; t < MemoryTag::Count; t++){
+        if (MemoryStats::Bytes(t) != 0 || MemoryStats::Allocations(t) != 0){
+            std::cout << "ERROR::MEMORY::LEAKED " << memoryTagNames[t] << " " << MemoryStats::Bytes(t) << " bytes in "
+                      << MemoryStats::Allocations(t) << " allocations" << std::endl;
+        }
+    }
+    return 0;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
@@ -0,0 +1,128 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <atomic>
+#include <string>
+#include <cstdio>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// Subsystems memory is accounted to
+namespace MemoryTag {
+    enum : int {
+        Voxels,         // Chunk block data
+        Light,          // Chunk light data
+        Meshes,         // Finished meshes kept in system memory
+        GpuBuffers,     // Chunk vertex and index buffers
+        JobQueues,      // Jobs waiting in the worker pool and the aprons they carry
+        WriteQueue,     // Voxel buffers waiting for ChunkIO to write them
+        Count
+    };
+}
+
+constexpr const char* memoryTagNames[MemoryTag::Count] = {
+    "voxels", "light", "meshes", "gpu_buffers", "job_queues", "write_queue"
+};
+
+// Live byte and allocation counts per subsystem. Allocation sites call
+// Allocated and Freed next to their new and delete, with the size they asked
+// for, so the counts are what the game holds rather than what the allocator
+// has reserved. Counters are relaxed atomics and safe to update from workers.
+// Every tag drops back to zero once the world is deleted, anything left is a
+// leak.
+class MemoryStats{
+    public:
+        static void Allocated(int tag, size_t bytes){
+            Counters& c = Get();
+            long long now = c.bytes[tag].fetch_add((long long)bytes, std::memory_order_relaxed) + (long long)bytes;
+            c.allocations[tag].fetch_add(1, std::memory_order_relaxed);
+
+            long long peak = c.peak[tag].load(std::memory_order_relaxed);
+            while (now > peak && !c.peak[tag].compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+        }
+
+        static void Freed(int tag, size_t bytes){
+            Counters& c = Get();
+            c.bytes[tag].fetch_sub((long long)bytes, std::memory_order_relaxed);
+            c.allocations[tag].fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        // Moves an allocation between tags, such as voxels handed to the write queue
+        static void Transfer(int from, int to, size_t bytes){
+            Freed(from, bytes);
+            Allocated(to, bytes);
+        }
+
+        static long long Bytes(int tag){ return Get().bytes[tag].load(std::memory_order_relaxed); }
+        static long long Allocations(int tag){ return Get().allocations[tag].load(std::memory_order_relaxed); }
+        static long long Peak(int tag){ return Get().peak[tag].load(std::memory_order_relaxed); }
+
+        static long long TotalBytes(){
+            long long total = 0;
+            for (int t = 0; t < MemoryTag::Count; t++) { total += Bytes(t); }
+            return total;
+        }
+
+        // Resident set size of the whole process, 0 where it cannot be read.
+        // Growing while the tagged totals stay flat points at untracked memory.
+        static long long ResidentBytes(){
+#ifdef __linux__
+            long long pages = 0, resident = 0;
+            FILE* f = std::fopen("/proc/self/statm", "r");
+            if (f == nullptr) { return 0; }
+            int read = std::fscanf(f, "%lld %lld", &pages, &resident);
+            std::fclose(f);
+            // Pages are 16K or 64K on some arm64 and ppc64le systems
+            static const long pageSize = sysconf(_SC_PAGESIZE);
+            return read == 2 && pageSize > 0 ? resident * pageSize : 0;
+#else
+            return 0;
+#endif
+        }
+
+        static std::string CsvHeader(){
+            std::string header = "seconds";
+            for (int t = 0; t < MemoryTag::Count; t++){
+                header += std::string(",") + memoryTagNames[t] + "_bytes," + memoryTagNames[t] + "_allocations";
+            }
+            return header + ",total_bytes,resident_bytes";
+        }
+
+        static std::string CsvRow(double seconds){
+            std::string row = std::to_string(seconds);
+            for (int t = 0; t < MemoryTag::Count; t++){
+                row += "," + std::to_string(Bytes(t)) + "," + std::to_string(Allocations(t));
+            }
+            return row + "," + std::to_string(TotalBytes()) + "," + std::to_string(ResidentBytes());
+        }
+
+        // One line in MB, used for the overlay and the headless log
+        static std::string Summary(){
+            std::string text;
+            for (int t = 0; t < MemoryTag::Count; t++){
+                text += std::string(memoryTagNames[t]) + " " + Megabytes(Bytes(t)) + " ";
+            }
+            return text + "| total " + Megabytes(TotalBytes()) + " rss " + Megabytes(ResidentBytes()) + " MB";
+        }
+
+        static std::string Megabytes(long long bytes){
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.1f", bytes / (1024.0 * 1024.0));
+            return buffer;
+        }
+
+    private:
+        struct Counters{
+            std::atomic<long long> bytes[MemoryTag::Count] = {};
+            std::atomic<long long> allocations[MemoryTag::Count] = {};
+            std::atomic<long long> peak[MemoryTag::Count] = {};
+        };
+
+        static Counters& Get(){
+            static Counters counters;
+            return counters;
+        }
+};
+
+#endif
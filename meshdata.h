@@ -0,0 +1,240 @@
+#ifndef MESHDATA_H
+#define MESHDATA_H
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+#include "glm/glm.hpp"
+#include "memstats.h"
+
+// Packed per-vertex attributes
+// Bits 0-3   - Block light
+// Bits 4-7   - Skylight
+// Bits 8-9   - Ambient occlusion, 0 fully occluded to 3 open
+// Bits 10-17 - Texture array layer
+// Bits 18-20 - Face direction, indexes the mesher's faceDefs
+struct Vertex{
+    glm::vec3 position;
+    unsigned int data;
+};
+
+// Vertices and indices of one vertical section of a chunk. Indices are
+// relative to vertexStart so a section can be moved or re-uploaded on its own.
+//
+// visibility records which of the section's faces are joined through open
+// blocks, bit (a * 6 + b) is set when face a can see face b. Faces follow the
+// mesher's order: +X, +Y, +Z, -X, -Y, -Z.
+//
+// solidLayers counts the completely solid layers at the bottom of the section,
+// used as an occluder box.
+//
+// Within a section the indices are grouped by face direction in the same
+// order, directionIndexCount holds the size of each group.
+struct MeshRange{
+    unsigned int vertexStart = 0, vertexCount = 0;
+    unsigned int indexStart = 0, indexCount = 0;
+    unsigned long long visibility = 0;
+    unsigned int solidLayers = 0;
+    unsigned int directionIndexCount[6] = {};
+};
+
+// Finished mesh owned by a chunk, allocated exactly to its contents
+class MeshData{
+    public:
+        static const int maxSections = 8;
+
+        Vertex* vertices = nullptr;
+        unsigned int* indices = nullptr;
+        size_t vertexCount = 0, indexCount = 0;
+
+        MeshRange sections[maxSections];
+        int sectionCount = 0;
+
+        MeshData(){}
+
+        MeshData(size_t vCount, size_t iCount){
+            vertexCount = vCount; indexCount = iCount;
+            if (vCount > 0){
+                vertices = new Vertex[vCount];
+                MemoryStats::Allocated(MemoryTag::Meshes, vCount * sizeof(Vertex));
+            }
+            if (iCount > 0){
+                indices = new unsigned int[iCount];
+                MemoryStats::Allocated(MemoryTag::Meshes, iCount * sizeof(unsigned int));
+            }
+        }
+
+        MeshData(MeshData&& other) noexcept { Swap(other); }
+
+        MeshData& operator=(MeshData&& other) noexcept {
+            if (this != &other){
+                Clear();
+                Swap(other);
+            }
+            return *this;
+        }
+
+        MeshData(const MeshData&) = delete;
+        MeshData& operator=(const MeshData&) = delete;
+
+        ~MeshData(){ Clear(); }
+
+        bool Empty() const { return indexCount == 0; }
+
+        void Clear(){
+            if (vertices != nullptr){
+                delete[] vertices; vertices = nullptr;
+                MemoryStats::Freed(MemoryTag::Meshes, vertexCount * sizeof(Vertex));
+            }
+            if (indices != nullptr){
+                delete[] indices; indices = nullptr;
+                MemoryStats::Freed(MemoryTag::Meshes, indexCount * sizeof(unsigned int));
+            }
+            vertexCount = 0; indexCount = 0;
+            sectionCount = 0;
+        }
+
+    private:
+        void Swap(MeshData& other){
+            std::swap(vertices, other.vertices);
+            std::swap(indices, other.indices);
+            std::swap(vertexCount, other.vertexCount);
+            std::swap(indexCount, other.indexCount);
+            std::swap(sections, other.sections);
+            std::swap(sectionCount, other.sectionCount);
+        }
+};
+
+// Per-thread arena the mesher writes into. Capacity only ever grows, so once a
+// thread has meshed a dense chunk it stops touching the heap until MoveOut.
+class MeshScratch{
+    public:
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        MeshRange sections[MeshData::maxSections];
+        int sectionCount = 0;
+
+        // Padded voxel copy the mesher reads from, see Chunk::FillApron
+        std::vector<unsigned int> apron;
+
+        // Exposed faces of the current section grouped by direction, see ChunkMesher::MeshSections
+        std::vector<int> directionFaces[6];
+
+        // Flood fill state for ChunkMesher::ComputeVisibility
+        std::vector<unsigned char> visited;
+        std::vector<int> fill;
+
+        // Downsampled blocks and light for level of detail meshes, see ChunkMesher::MeshLod
+        std::vector<unsigned short> coarse;
+        std::vector<unsigned char> coarseLight;
+        std::vector<unsigned char> coarseBlock;
+        // Neighbour ground along each side, see ChunkMesher::MeshLod
+        std::vector<int> edgeHeight;
+
+        static MeshScratch& ForThread(){
+            static thread_local MeshScratch scratch;
+            return scratch;
+        }
+
+        // faceCount comes from the mesher's counting pass, each face is one quad
+        void Begin(size_t faceCount){
+            vertices.clear();
+            indices.clear();
+            sectionCount = 0;
+            if (vertices.capacity() < faceCount * 4) { vertices.reserve(faceCount * 4); }
+            if (indices.capacity() < faceCount * 6) { indices.reserve(faceCount * 6); }
+        }
+
+        void BeginSection(){
+            MeshRange& r = sections[sectionCount];
+            r.vertexStart = static_cast<unsigned int>(vertices.size());
+            r.indexStart = static_cast<unsigned int>(indices.size());
+            for (int d = 0; d < 6; d++) { r.directionIndexCount[d] = 0; }
+            directionStart = r.indexStart;
+        }
+
+        // Closes the group of faces pointing along direction d
+        void EndDirection(int d){
+            unsigned int end = static_cast<unsigned int>(indices.size());
+            sections[sectionCount].directionIndexCount[d] = end - directionStart;
+            directionStart = end;
+        }
+
+        void EndSection(){
+            MeshRange& r = sections[sectionCount];
+            r.vertexCount = static_cast<unsigned int>(vertices.size()) - r.vertexStart;
+            r.indexCount = static_cast<unsigned int>(indices.size()) - r.indexStart;
+            sectionCount++;
+        }
+
+        // Corners go round the quad in order. flip splits it along the b-d
+        // diagonal instead of a-c, used to keep AO gradients symmetric.
+        void AddQuad(const Vertex& a, const Vertex& b, const Vertex& c, const Vertex& d, bool flip){
+            unsigned int base = static_cast<unsigned int>(vertices.size()) - sections[sectionCount].vertexStart;
+            vertices.push_back(a);
+            vertices.push_back(b);
+            vertices.push_back(c);
+            vertices.push_back(d);
+
+            if (flip){
+                indices.push_back(base + 1); indices.push_back(base + 2); indices.push_back(base + 3);
+                indices.push_back(base + 1); indices.push_back(base + 3); indices.push_back(base);
+            } else {
+                indices.push_back(base); indices.push_back(base + 1); indices.push_back(base + 2);
+                indices.push_back(base); indices.push_back(base + 2); indices.push_back(base + 3);
+            }
+        }
+
+        // Builds the exactly sized result. Sections whose bit is not set in
+        // meshedSections were skipped by the mesher and are taken from base.
+        MeshData MoveOut(const MeshData* base = nullptr, unsigned int meshedSections = ~0u){
+            size_t vCount = 0, iCount = 0;
+            for (int s = 0; s < sectionCount; s++) {
+                const MeshRange& r = Source(base, meshedSections, s);
+                vCount += r.vertexCount;
+                iCount += r.indexCount;
+            }
+
+            MeshData mesh(vCount, iCount);
+            mesh.sectionCount = sectionCount;
+
+            unsigned int vOffset = 0, iOffset = 0;
+            for (int s = 0; s < sectionCount; s++) {
+                bool fresh = Fresh(base, meshedSections, s);
+                const MeshRange& r = Source(base, meshedSections, s);
+                const Vertex* vSrc = fresh ? vertices.data() : base->vertices;
+                const unsigned int* iSrc = fresh ? indices.data() : base->indices;
+
+                if (r.vertexCount > 0) { std::memcpy(mesh.vertices + vOffset, vSrc + r.vertexStart, r.vertexCount * sizeof(Vertex)); }
+                if (r.indexCount > 0) { std::memcpy(mesh.indices + iOffset, iSrc + r.indexStart, r.indexCount * sizeof(unsigned int)); }
+
+                MeshRange& out = mesh.sections[s];
+                out.vertexStart = vOffset; out.vertexCount = r.vertexCount;
+                out.indexStart = iOffset; out.indexCount = r.indexCount;
+                out.visibility = r.visibility;
+                out.solidLayers = r.solidLayers;
+                for (int d = 0; d < 6; d++) { out.directionIndexCount[d] = r.directionIndexCount[d]; }
+                vOffset += r.vertexCount;
+                iOffset += r.indexCount;
+            }
+
+            vertices.clear();
+            indices.clear();
+            sectionCount = 0;
+            return mesh;
+        }
+
+    private:
+        unsigned int directionStart = 0;
+
+        bool Fresh(const MeshData* base, unsigned int meshedSections, int s){
+            return base == nullptr || (meshedSections & (1u << s)) != 0 || s >= base->sectionCount;
+        }
+
+        const MeshRange& Source(const MeshData* base, unsigned int meshedSections, int s){
+            return Fresh(base, meshedSections, s) ? sections[s] : base->sections[s];
+        }
+};
+
+#endif
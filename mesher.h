@@ -0,0 +1,391 @@
+#ifndef MESHER_H
+#define MESHER_H
+
+#include <vector>
+#include <algorithm>
+
+#include "meshdata.h"
+#include "blockregistry.h"
+#include "glm/glm.hpp"
+
+// Turns the voxels of one chunk into a MeshData. The mesher only ever reads
+// an apron, a padded copy of the chunk described below, so it never touches a
+// Chunk, a neighbour or any GL state and can run on any thread. Scratch space
+// comes from the calling thread's MeshScratch.
+class ChunkMesher{
+    public:
+        static const int sectionSize = 16;
+
+        // 0 is full detail, level n merges 2^n blocks along each axis
+        static const int maxLod = 3;
+
+        // Off leaves every corner fully lit, for measuring what the corner
+        // occlusion lookups cost
+        bool ambientOcclusion = true;
+
+        ChunkMesher(int cXS, int cYS, int cZS){
+            chunkXSize = cXS; chunkYSize = cYS; chunkZSize = cZS;
+        }
+
+        // Meshes at level, the sections outside mask are left empty. Level of
+        // detail meshes are always built whole.
+        void Mesh(MeshScratch& scratch, const unsigned int* apron, unsigned int mask, int level){
+            if (level == 0) { MeshSections(scratch, apron, mask); }
+            else { MeshLod(scratch, apron, level); }
+        }
+
+        // Meshes the chunk downsampled by 2^level on each axis. A coarse cell is
+        // solid when at least half of its blocks are, and takes the brightest
+        // light of its open blocks. Faces on the chunk's sides are emitted down
+        // to one cell below the lowest ground of the neighbour along that
+        // stretch of border, these act as skirts hiding the cracks against
+        // neighbours meshed at a different level. Below that the neighbour is
+        // solid, so a skirt would never be seen.
+        void MeshLod(MeshScratch& scratch, const unsigned int* apron, int level){
+            int scale = 1 << level;
+            int cX = chunkXSize / scale, cY = chunkYSize / scale, cZ = chunkZSize / scale;
+            std::vector<unsigned short>& coarse = scratch.coarse;
+            std::vector<unsigned char>& coarseLight = scratch.coarseLight;
+            std::vector<unsigned char>& coarseBlock = scratch.coarseBlock;
+            coarse.assign(cX * cY * cZ, 0);
+            coarseLight.assign(cX * cY * cZ, 0);
+            coarseBlock.assign(cX * cY * cZ, Blocks::Stone);
+
+            for (int y = 0; y < cY * scale; y++){
+                for (int z = 0; z < cZ * scale; z++){
+                    for (int x = 0; x < cX * scale; x++){
+                        unsigned int v = apron[ApronIndex(x, y, z)];
+                        int c = (x / scale) + cX * ((z / scale) + cZ * (y / scale));
+                        if (Opaque(v)) { coarse[c]++; coarseBlock[c] = (unsigned char)(v & apronBlockMask); } // Highest block wins
+                        else if ((v >> apronLightShift) > coarseLight[c]) { coarseLight[c] = (unsigned char)(v >> apronLightShift); }
+                    }
+                }
+            }
+
+            int half = (scale * scale * scale + 1) / 2;
+            for (size_t i = 0; i < coarse.size(); i++) { coarse[i] = coarse[i] >= half; }
+
+            // Lowest ground of the neighbour on each side, per coarse cell along
+            // the border, from the apron's border layer. A missing neighbour is
+            // stone in the apron, so it gets no skirt at all.
+            std::vector<int>& edgeHeight = scratch.edgeHeight;
+            edgeHeight.assign(2 * cZ + 2 * cX, chunkYSize);
+            for (int i = 0; i < cZ * scale; i++){
+                int& left = edgeHeight[i / scale];
+                int& right = edgeHeight[cZ + i / scale];
+                left = std::min(left, GroundHeight(apron, -1, i));
+                right = std::min(right, GroundHeight(apron, chunkXSize, i));
+            }
+            for (int i = 0; i < cX * scale; i++){
+                int& back = edgeHeight[2 * cZ + i / scale];
+                int& front = edgeHeight[2 * cZ + cX + i / scale];
+                back = std::min(back, GroundHeight(apron, i, -1));
+                front = std::min(front, GroundHeight(apron, i, chunkZSize));
+            }
+
+            // Outside the sides is solid up to one cell below the neighbour's
+            // ground and open sky above, above and below the chunk count as
+            // solid like the full mesh
+            auto cell = [&](int x, int y, int z, unsigned int& light) -> bool {
+                if (y < 0 || y >= cY) { light = 0; return true; }
+                int ground = -1;
+                if (x < 0) { ground = edgeHeight[z]; }
+                else if (x >= cX) { ground = edgeHeight[cZ + z]; }
+                else if (z < 0) { ground = edgeHeight[2 * cZ + x]; }
+                else if (z >= cZ) { ground = edgeHeight[2 * cZ + cX + x]; }
+                if (ground >= 0) { light = 15 << 4; return (y + 2) * scale <= ground; }
+
+                int c = x + cX * (z + cZ * y);
+                light = coarseLight[c];
+                return coarse[c] != 0;
+            };
+
+            size_t faces = 0;
+            unsigned int light;
+            for (int y = 0; y < cY; y++){
+                for (int z = 0; z < cZ; z++){
+                    for (int x = 0; x < cX; x++){
+                        if (!coarse[x + cX * (z + cZ * y)]) { continue; }
+                        for (int f = 0; f < 6; f++){
+                            glm::ivec3 n = glm::ivec3(x, y, z) + faceDefs[f].normal;
+                            if (!cell(n.x, n.y, n.z, light)) { faces++; }
+                        }
+                    }
+                }
+            }
+            scratch.Begin(faces);
+
+            int cellsPerSection = std::max(1, sectionSize / scale);
+            for (int s = 0; s < SectionCount(); s++){
+                scratch.BeginSection();
+                int yEnd = std::min(cY, (s + 1) * cellsPerSection);
+                for (int f = 0; f < 6; f++){
+                    for (int y = s * cellsPerSection; y < yEnd; y++){
+                        for (int z = 0; z < cZ; z++){
+                            for (int x = 0; x < cX; x++){
+                                if (!coarse[x + cX * (z + cZ * y)]) { continue; }
+                                glm::ivec3 n = glm::ivec3(x, y, z) + faceDefs[f].normal;
+                                if (cell(n.x, n.y, n.z, light)) { continue; }
+
+                                glm::vec3 pos = glm::vec3(x, y, z) * (float)scale;
+                                unsigned int texture = FaceTexture(coarseBlock[x + cX * (z + cZ * y)], f);
+                                Vertex v[4];
+                                for (int c = 0; c < 4; c++){
+                                    v[c].position = pos + glm::vec3(faceDefs[f].corners[c]) * (float)scale;
+                                    v[c].data = light | (3 << 8) | texture;
+                                }
+                                scratch.AddQuad(v[0], v[1], v[2], v[3], false);
+                            }
+                        }
+                    }
+                    scratch.EndDirection(f);
+                }
+                // Culling uses the full resolution blocks whatever the mesh level
+                ComputeVisibility(scratch, apron, s);
+                scratch.EndSection();
+            }
+        }
+
+        // The mesher reads voxels from a copy padded by one block on every side,
+        // so faces on the chunk border can see into the neighbouring chunks.
+        // Layout matches the voxel store: x fastest, then z, then y.
+        int ApronSize(){ return (chunkXSize + 2) * (chunkYSize + 2) * (chunkZSize + 2); }
+
+        int ApronIndex(int x, int y, int z){
+            return (x + 1) + (chunkXSize + 2) * ((z + 1) + (chunkZSize + 2) * (y + 1));
+        }
+
+        // Each apron entry packs the block id with its light in the top byte
+        static const unsigned int apronBlockMask = 0x00FFFFFF;
+        static const int apronLightShift = 24;
+
+        // Height of the highest opaque block in a column of the apron, 0 when
+        // there is none
+        int GroundHeight(const unsigned int* apron, int x, int z){
+            for (int y = chunkYSize - 1; y >= 0; y--){
+                if (Opaque(apron[ApronIndex(x, y, z)])) { return y + 1; }
+            }
+            return 0;
+        }
+
+        // Filled blocks get faces, opaque ones hide the faces next to them
+        static bool Filled(unsigned int apronValue){ return (apronValue & apronBlockMask) != Blocks::Air; }
+        static bool Opaque(unsigned int apronValue){ return BlockRegistry::Opaque(apronValue & apronBlockMask); }
+
+        int SectionCount(){ return (chunkYSize + sectionSize - 1) / sectionSize; }
+        unsigned int AllSections(){ return (1u << SectionCount()) - 1; }
+
+        // Emits every section, only the ones in mask get geometry
+        void MeshSections(MeshScratch& scratch, const unsigned int* apron, unsigned int mask){
+            scratch.Begin(CountFaces(apron, mask));
+
+            FaceOffsets offsets;
+            ComputeFaceOffsets(offsets);
+
+            for (int s = 0; s < SectionCount(); s++){
+                scratch.BeginSection();
+                if (mask & (1u << s)){
+                    // One pass finds the exposed faces, then each direction is emitted in turn
+                    for (int f = 0; f < 6; f++) { scratch.directionFaces[f].clear(); }
+                    int yEnd = std::min(chunkYSize, (s + 1) * sectionSize);
+                    for (int y = s * sectionSize; y < yEnd; y++){
+                        for (int z = 0; z < chunkZSize; z++){
+                            for (int x = 0; x < chunkXSize; x++){
+                                int i = ApronIndex(x, y, z);
+                                if (!Filled(apron[i])) { continue; }
+                                for (int f = 0; f < 6; f++){
+                                    if (!Opaque(apron[i + offsets.front[f]])) { scratch.directionFaces[f].push_back(x | (y << 8) | (z << 16)); }
+                                }
+                            }
+                        }
+                    }
+
+                    for (int f = 0; f < 6; f++){
+                        const std::vector<int>& faces = scratch.directionFaces[f];
+                        for (size_t i = 0; i < faces.size(); i++){
+                            GenerateFace(scratch, apron, offsets, f, faces[i] & 0xFF, (faces[i] >> 8) & 0xFF, faces[i] >> 16);
+                        }
+                        scratch.EndDirection(f);
+                    }
+                    ComputeVisibility(scratch, apron, s);
+                }
+                scratch.EndSection();
+            }
+        }
+
+        // Flood fills the open blocks of a section and records which of its six
+        // faces each open region touches. Two faces are connected when one
+        // region touches both. Runs at mesh time so culling never looks at blocks.
+        void ComputeVisibility(MeshScratch& scratch, const unsigned int* apron, int s){
+            int yStart = s * sectionSize, yEnd = std::min(chunkYSize, (s + 1) * sectionSize);
+            int height = yEnd - yStart;
+            int volume = chunkXSize * height * chunkZSize;
+            const unsigned long long allFaces = (1ull << 36) - 1;
+
+            // Solid blocks start out visited so the fill only looks at one array
+            std::vector<unsigned char>& visited = scratch.visited;
+            visited.resize(volume);
+            int open = 0, solidLayers = 0;
+            for (int y = 0; y < height; y++){
+                for (int z = 0; z < chunkZSize; z++){
+                    const unsigned int* row = apron + ApronIndex(0, yStart + y, z);
+                    unsigned char* out = visited.data() + chunkXSize * (z + chunkZSize * y);
+                    for (int x = 0; x < chunkXSize; x++){
+                        out[x] = Opaque(row[x]) ? 1 : 0;
+                        open += 1 - out[x];
+                    }
+                }
+                if (open == 0) { solidLayers = y + 1; }
+            }
+            scratch.sections[scratch.sectionCount].solidLayers = solidLayers;
+
+            unsigned long long visibility = 0;
+            if (open == volume) { visibility = allFaces; }
+            else if (open > 0){
+                int strides[6] = { 1, chunkXSize * chunkZSize, chunkXSize, -1, -chunkXSize * chunkZSize, -chunkXSize };
+                int limits[3] = { chunkXSize - 1, height - 1, chunkZSize - 1 };
+
+                // Queue entries pack x, y and z a byte each so no division is needed
+                std::vector<int>& fill = scratch.fill;
+                for (int start = 0; start < volume && visibility != allFaces; start++){
+                    if (visited[start]) { continue; }
+
+                    unsigned int touched = 0;
+                    fill.clear();
+                    fill.push_back((start % chunkXSize) | ((start / (chunkXSize * chunkZSize)) << 8) | (((start / chunkXSize) % chunkZSize) << 16));
+                    visited[start] = 1;
+                    for (size_t head = 0; head < fill.size(); head++){
+                        int packed = fill[head];
+                        int p[3] = { packed & 0xFF, (packed >> 8) & 0xFF, packed >> 16 };
+                        int i = p[0] + chunkXSize * (p[2] + chunkZSize * p[1]);
+
+                        for (int f = 0; f < 6; f++){
+                            int axis = f % 3;
+                            if (p[axis] == (f < 3 ? limits[axis] : 0)) { touched |= 1u << f; continue; }
+
+                            int n = i + strides[f];
+                            if (visited[n]) { continue; }
+                            visited[n] = 1;
+                            fill.push_back(packed + (f < 3 ? 1 : -1) * (1 << (axis * 8)));
+                        }
+                    }
+
+                    for (int a = 0; a < 6; a++){
+                        if (touched & (1u << a)) { visibility |= (unsigned long long)touched << (a * 6); }
+                    }
+                }
+            }
+            scratch.sections[scratch.sectionCount].visibility = visibility;
+        }
+
+        // Counting pass so the scratch arena can be reserved up front
+        size_t CountFaces(const unsigned int* apron, unsigned int mask){
+            size_t faces = 0;
+            const int dx = 1, dy = (chunkXSize + 2) * (chunkZSize + 2), dz = chunkXSize + 2;
+            for (int s = 0; s < SectionCount(); s++){
+                if ((mask & (1u << s)) == 0) { continue; }
+                int yEnd = std::min(chunkYSize, (s + 1) * sectionSize);
+                for (int y = s * sectionSize; y < yEnd; y++){
+                    for (int z = 0; z < chunkZSize; z++){
+                        for (int x = 0; x < chunkXSize; x++){
+                            int i = ApronIndex(x, y, z);
+                            if (Filled(apron[i])) {
+                                faces += !Opaque(apron[i + dx]) + !Opaque(apron[i + dy]) + !Opaque(apron[i + dz]) +
+                                         !Opaque(apron[i - dx]) + !Opaque(apron[i - dy]) + !Opaque(apron[i - dz]);
+                            }
+                        }
+                    }
+                }
+            }
+            return faces;
+        }
+
+        // faceDefs turned into apron index offsets for the current chunk size
+        struct FaceOffsets{
+            int front[6];
+            int side1[6][4], side2[6][4];
+        };
+
+        void ComputeFaceOffsets(FaceOffsets& offsets){
+            const int strideY = (chunkXSize + 2) * (chunkZSize + 2), strideZ = chunkXSize + 2;
+            for (int f = 0; f < 6; f++){
+                const FaceDef& face = faceDefs[f];
+                offsets.front[f] = face.normal.x + face.normal.y * strideY + face.normal.z * strideZ;
+                for (int c = 0; c < 4; c++){
+                    glm::ivec3 side1(0), side2(0);
+                    side1[face.tangent1] = face.corners[c][face.tangent1] ? 1 : -1;
+                    side2[face.tangent2] = face.corners[c][face.tangent2] ? 1 : -1;
+                    offsets.side1[f][c] = side1.x + side1.y * strideY + side1.z * strideZ;
+                    offsets.side2[f][c] = side2.x + side2.y * strideY + side2.z * strideZ;
+                }
+            }
+        }
+
+        // Emits face f of one block. Each corner gets the light of the
+        // cell the face looks into and an occlusion value from the three blocks
+        // that touch that corner in the same layer.
+        void GenerateFace(MeshScratch& scratch, const unsigned int* apron, const FaceOffsets& offsets, int f, int x, int y, int z){
+            int front = ApronIndex(x, y, z) + offsets.front[f];
+            unsigned int light = apron[front] >> apronLightShift;
+            unsigned int texture = FaceTexture(apron[ApronIndex(x, y, z)] & apronBlockMask, f);
+            glm::vec3 pos = glm::vec3(x, y, z);
+
+            Vertex v[4];
+            int ao[4];
+            for (int c = 0; c < 4; c++){
+                int s1 = offsets.side1[f][c], s2 = offsets.side2[f][c];
+                ao[c] = ambientOcclusion ? VertexAO(Opaque(apron[front + s1]), Opaque(apron[front + s2]), Opaque(apron[front + s1 + s2])) : 3;
+                v[c].position = pos + glm::vec3(faceDefs[f].corners[c]);
+                v[c].data = light | (ao[c] << 8) | texture;
+            }
+
+            // Split along the brighter diagonal so occlusion does not smear
+            scratch.AddQuad(v[0], v[1], v[2], v[3], ao[0] + ao[2] < ao[1] + ao[3]);
+        }
+
+        // Texture layer and face direction bits of the vertex data
+        static unsigned int FaceTexture(unsigned int block, int f){
+            return ((unsigned int)BlockRegistry::Layer(block, f) << 10) | ((unsigned int)f << 18);
+        }
+
+        static int VertexAO(bool side1, bool side2, bool corner){
+            if (side1 && side2) { return 0; }
+            return 3 - (side1 + side2 + corner);
+        }
+
+        // Bit d is set when a face pointing along faceDefs[d] somewhere inside
+        // section s can face the eye
+        unsigned int FacingDirections(glm::vec3 eye, int s) const {
+            glm::vec3 min = glm::vec3(0, s * sectionSize, 0);
+            glm::vec3 max = glm::vec3(chunkXSize, std::min(chunkYSize, (s + 1) * sectionSize), chunkZSize);
+            unsigned int directions = 0;
+            for (int axis = 0; axis < 3; axis++){
+                if (eye[axis] > min[axis]) { directions |= 1u << axis; }
+                if (eye[axis] < max[axis]) { directions |= 1u << (axis + 3); }
+            }
+            return directions;
+        }
+
+        // Corners of each face of the unit cube in order round the quad, and the
+        // two axes lying in the face
+        struct FaceDef{
+            glm::ivec3 normal;
+            glm::ivec3 corners[4];
+            int tangent1, tangent2;
+        };
+
+        // Corners run counter clockwise seen from outside, so back faces can be culled
+        static constexpr FaceDef faceDefs[6] = {
+            { glm::ivec3( 1, 0, 0), { glm::ivec3(1,0,0), glm::ivec3(1,1,0), glm::ivec3(1,1,1), glm::ivec3(1,0,1) }, 1, 2 },
+            { glm::ivec3( 0, 1, 0), { glm::ivec3(0,1,0), glm::ivec3(0,1,1), glm::ivec3(1,1,1), glm::ivec3(1,1,0) }, 0, 2 },
+            { glm::ivec3( 0, 0, 1), { glm::ivec3(0,0,1), glm::ivec3(1,0,1), glm::ivec3(1,1,1), glm::ivec3(0,1,1) }, 0, 1 },
+            { glm::ivec3(-1, 0, 0), { glm::ivec3(0,0,0), glm::ivec3(0,0,1), glm::ivec3(0,1,1), glm::ivec3(0,1,0) }, 1, 2 },
+            { glm::ivec3( 0,-1, 0), { glm::ivec3(0,0,0), glm::ivec3(1,0,0), glm::ivec3(1,0,1), glm::ivec3(0,0,1) }, 0, 2 },
+            { glm::ivec3( 0, 0,-1), { glm::ivec3(0,0,0), glm::ivec3(0,1,0), glm::ivec3(1,1,0), glm::ivec3(1,0,0) }, 0, 1 },
+        };
+
+    private:
+        int chunkXSize, chunkYSize, chunkZSize;
+};
+
+#endif
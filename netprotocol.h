@@ -0,0 +1,241 @@
+#ifndef NETPROTOCOL_H
+#define NETPROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "chunkcodec.h"
+
+// Messages between the chunk server and its clients. Every message is an
+// 8 byte header, uint32 body length then uint32 type, followed by the body.
+// Integers are sent in host byte order, client and server are expected to
+// share an architecture.
+//
+// ChunkRequest: int32 x, int32 z
+// ChunkData:    int32 x, int32 z, uint32 encoding, payload, see chunkcodec.h
+// Hello:        uint32 bit per encoding the client reads, Raw until sent
+// BlockDeltas:  a DeltaBatch, one per tick at most, in both directions. The
+//               server forwards a client's edits to every other client it
+//               has sent the chunk to.
+// ChunkForget:  int32 x, int32 z, the client has dropped its copy, so the
+//               server stops forwarding that chunk's edits to it
+namespace MessageType {
+    enum : uint32_t {
+        ChunkRequest = 1,
+        ChunkData = 2,
+        Hello = 3,
+        BlockDeltas = 4,
+        ChunkForget = 5,
+    };
+}
+
+struct Message{
+    uint32_t type = 0;
+    std::vector<unsigned char> body;
+};
+
+// One non-blocking socket with buffered, framed reads and writes. Send only
+// queues, Flush writes as much as the socket takes, Receive reads whatever
+// has arrived and Next pops complete messages off it.
+class Connection{
+    public:
+        static const size_t headerSize = 8;
+        // Larger bodies are treated as a corrupt stream
+        static const uint32_t maxBody = 16 * 1024 * 1024;
+
+        int fd;
+
+        Connection(int socketFd){
+            fd = socketFd;
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        }
+
+        ~Connection(){ Close(); }
+
+        void Close(){
+            if (fd != -1) { close(fd); fd = -1; }
+        }
+
+        bool Open(){ return fd != -1; }
+
+        void Send(uint32_t type, const void* body, size_t length){ Send(type, nullptr, 0, body, length); }
+
+        // Body made of two parts, so a fixed header and a payload held
+        // elsewhere are copied once
+        void Send(uint32_t type, const void* prefix, size_t prefixLength, const void* body, size_t length){
+            size_t start = outbox.size();
+            outbox.resize(start + headerSize + prefixLength + length);
+            uint32_t size = (uint32_t)(prefixLength + length);
+            unsigned char* out = outbox.data() + start;
+            std::memcpy(out, &size, 4);
+            std::memcpy(out + 4, &type, 4);
+            if (prefixLength > 0) { std::memcpy(out + headerSize, prefix, prefixLength); }
+            if (length > 0) { std::memcpy(out + headerSize + prefixLength, body, length); }
+        }
+
+        // False once the connection has failed
+        bool Flush(){
+            while (fd != -1 && sent < outbox.size()){
+                ssize_t n = send(fd, outbox.data() + sent, outbox.size() - sent, MSG_NOSIGNAL);
+                if (n > 0) { sent += n; continue; }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+                if (n < 0 && errno == EINTR) { continue; }
+                Close();
+                return false;
+            }
+            // Sent bytes are dropped once they make up most of the buffer
+            if (sent == outbox.size()) { outbox.clear(); sent = 0; }
+            else if (sent > outbox.size() / 2) { outbox.erase(outbox.begin(), outbox.begin() + sent); sent = 0; }
+            return fd != -1;
+        }
+
+        bool WantsWrite(){ return sent < outbox.size(); }
+        size_t Queued(){ return outbox.size() - sent; }
+
+        // False once the peer has closed or the connection has failed
+        bool Receive(){
+            unsigned char buffer[64 * 1024];
+            while (fd != -1){
+                ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                if (n > 0) { inbox.insert(inbox.end(), buffer, buffer + n); continue; }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+                if (n < 0 && errno == EINTR) { continue; }
+                Close();
+                return false;
+            }
+            return fd != -1;
+        }
+
+        bool Next(Message& message){
+            if (inbox.size() - read < headerSize) { Compact(); return false; }
+            uint32_t length;
+            std::memcpy(&length, inbox.data() + read, 4);
+            if (length > maxBody){
+                std::cout << "ERROR::NET::MESSAGE_TOO_LARGE " << length << std::endl;
+                Close();
+                return false;
+            }
+            if (inbox.size() - read < headerSize + length) { Compact(); return false; }
+
+            std::memcpy(&message.type, inbox.data() + read + 4, 4);
+            message.body.assign(inbox.begin() + read + headerSize, inbox.begin() + read + headerSize + length);
+            read += headerSize + length;
+            return true;
+        }
+
+    private:
+        std::vector<unsigned char> outbox, inbox;
+        size_t sent = 0, read = 0;
+
+        void Compact(){
+            if (read == 0) { return; }
+            inbox.erase(inbox.begin(), inbox.begin() + read);
+            read = 0;
+        }
+};
+
+// Addresses are "unix:<path>" for a Unix domain socket or "<host>:<port>"
+// for TCP, host may be left empty to mean every interface or localhost.
+namespace NetAddress {
+    inline bool IsUnix(const std::string& address){ return address.compare(0, 5, "unix:") == 0; }
+
+    inline bool UnixAddress(const std::string& address, sockaddr_un& out){
+        std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(out.sun_path)) { return false; }
+        std::memset(&out, 0, sizeof(out));
+        out.sun_family = AF_UNIX;
+        std::memcpy(out.sun_path, path.c_str(), path.size());
+        return true;
+    }
+
+    inline addrinfo* Resolve(const std::string& address, bool passive){
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) { return nullptr; }
+        std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (passive) { hints.ai_flags = AI_PASSIVE; }
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0) { return nullptr; }
+        return result;
+    }
+
+    // Requests are small and latency matters more than packet count. Fails
+    // harmlessly on Unix domain sockets.
+    inline void NoDelay(int fd){
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    // Returns the listening socket, or -1
+    inline int Listen(const std::string& address){
+        int fd = -1;
+        if (IsUnix(address)){
+            sockaddr_un addr;
+            if (UnixAddress(address, addr) && (fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1){
+                unlink(addr.sun_path); // Left behind by a server that did not shut down cleanly
+                if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) { close(fd); fd = -1; }
+            }
+        } else {
+            addrinfo* info = Resolve(address, true);
+            for (addrinfo* a = info; a != nullptr && fd == -1; a = a->ai_next){
+                fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                if (fd == -1) { continue; }
+                int on = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+                if (bind(fd, a->ai_addr, a->ai_addrlen) != 0) { close(fd); fd = -1; }
+            }
+            if (info != nullptr) { freeaddrinfo(info); }
+        }
+
+        if (fd == -1 || listen(fd, 64) != 0){
+            std::cout << "ERROR::NET::LISTEN_FAILED " << address << std::endl;
+            if (fd != -1) { close(fd); }
+            return -1;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        return fd;
+    }
+
+    // Blocking connect, returns the socket or -1
+    inline int Connect(const std::string& address){
+        int fd = -1;
+        if (IsUnix(address)){
+            sockaddr_un addr;
+            if (UnixAddress(address, addr) && (fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1){
+                if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) { close(fd); fd = -1; }
+            }
+        } else {
+            addrinfo* info = Resolve(address, false);
+            for (addrinfo* a = info; a != nullptr && fd == -1; a = a->ai_next){
+                fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                if (fd == -1) { continue; }
+                if (connect(fd, a->ai_addr, a->ai_addrlen) != 0) { close(fd); fd = -1; continue; }
+                NoDelay(fd);
+            }
+            if (info != nullptr) { freeaddrinfo(info); }
+        }
+
+        if (fd == -1) { std::cout << "ERROR::NET::CONNECT_FAILED " << address << std::endl; }
+        return fd;
+    }
+}
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "glm/glm.hpp"
+
+// Software occlusion culling that runs entirely on the CPU. Each frame the
+// solid boxes of the nearest chunks are rasterized into a small depth buffer,
+// which is then reduced into min and max depth pyramids. Boxes further away
+// are projected, checked against the frustum and then against the pyramid
+// level where their screen rectangle covers a couple of texels: if the nearest
+// point of the box is behind the furthest occluder depth there, it is hidden.
+//
+// Occluders write the furthest depth of each of their triangles, and boxes
+// crossing the near plane are skipped, so the buffer never claims more is
+// covered than really is.
+class OcclusionCuller{
+    public:
+        static const int width = 256, height = 128;
+
+        struct Stats{
+            size_t occluders;       // boxes rasterized this frame
+            size_t tested;          // boxes tested this frame
+            size_t frustumCulled;
+            size_t occluded;
+        };
+
+        bool enabled = true;
+        Stats stats = {};
+
+        OcclusionCuller(){
+            int w = width, h = height;
+            while (true){
+                maxLevels.push_back(std::vector<float>(w * h, 1.0f));
+                minLevels.push_back(std::vector<float>(w * h, 1.0f));
+                levelWidth.push_back(w);
+                levelHeight.push_back(h);
+                if (w == 1 && h == 1) { break; }
+                w = std::max(1, w / 2); h = std::max(1, h / 2);
+            }
+        }
+
+        void Begin(const glm::mat4& viewProjection, glm::vec3 cameraPosition){
+            viewProj = viewProjection;
+            camPos = cameraPosition;
+            stats = Stats{};
+            std::fill(maxLevels[0].begin(), maxLevels[0].end(), 1.0f);
+        }
+
+        // Rasterizes the faces of a solid box that point at the camera
+        void AddOccluder(glm::vec3 min, glm::vec3 max){
+            if (!enabled) { return; }
+
+            glm::vec3 screen[8];
+            for (int i = 0; i < 8; i++){
+                glm::vec4 clip = viewProj * glm::vec4(Corner(min, max, i), 1.0f);
+                if (clip.w < nearW || clip.z < -clip.w) { return; }
+                screen[i] = ToScreen(clip);
+            }
+
+            // Corner index bits are x, y, z. Each face lists its corners in order round the quad.
+            static const int faces[6][4] = {
+                { 0, 2, 6, 4 }, { 1, 3, 7, 5 },     // -X, +X
+                { 0, 1, 5, 4 }, { 2, 3, 7, 6 },     // -Y, +Y
+                { 0, 1, 3, 2 }, { 4, 5, 7, 6 }      // -Z, +Z
+            };
+            for (int axis = 0; axis < 3; axis++){
+                int face = -1;
+                if (camPos[axis] < min[axis]) { face = axis * 2; }
+                else if (camPos[axis] > max[axis]) { face = axis * 2 + 1; }
+                if (face == -1) { continue; }
+
+                const int* q = faces[face];
+                RasterizeTriangle(screen[q[0]], screen[q[1]], screen[q[2]]);
+                RasterizeTriangle(screen[q[0]], screen[q[2]], screen[q[3]]);
+            }
+            stats.occluders++;
+        }
+
+        // Builds the depth pyramids, call after the last AddOccluder
+        void Finish(){
+            minLevels[0] = maxLevels[0];
+            for (size_t l = 1; l < maxLevels.size(); l++){
+                int w = levelWidth[l], h = levelHeight[l];
+                int pw = levelWidth[l - 1], ph = levelHeight[l - 1];
+                const std::vector<float>& pMax = maxLevels[l - 1];
+                const std::vector<float>& pMin = minLevels[l - 1];
+
+                for (int y = 0; y < h; y++){
+                    int y0 = std::min(y * 2, ph - 1), y1 = std::min(y * 2 + 1, ph - 1);
+                    for (int x = 0; x < w; x++){
+                        int x0 = std::min(x * 2, pw - 1), x1 = std::min(x * 2 + 1, pw - 1);
+                        maxLevels[l][x + w * y] = std::max(std::max(pMax[x0 + pw * y0], pMax[x1 + pw * y0]),
+                                                           std::max(pMax[x0 + pw * y1], pMax[x1 + pw * y1]));
+                        minLevels[l][x + w * y] = std::min(std::min(pMin[x0 + pw * y0], pMin[x1 + pw * y0]),
+                                                           std::min(pMin[x0 + pw * y1], pMin[x1 + pw * y1]));
+                    }
+                }
+            }
+        }
+
+        // False when the box is outside the frustum
+        bool InFrustum(glm::vec3 min, glm::vec3 max){
+            stats.tested++;
+
+            glm::vec4 clip[8];
+            for (int i = 0; i < 8; i++) { clip[i] = viewProj * glm::vec4(Corner(min, max, i), 1.0f); }
+            if (OutsideFrustum(clip)) { stats.frustumCulled++; return false; }
+            return true;
+        }
+
+        // False when the box is outside the frustum or behind the occluders
+        bool Visible(glm::vec3 min, glm::vec3 max){
+            stats.tested++;
+
+            glm::vec4 clip[8];
+            for (int i = 0; i < 8; i++) { clip[i] = viewProj * glm::vec4(Corner(min, max, i), 1.0f); }
+            if (OutsideFrustum(clip)) { stats.frustumCulled++; return false; }
+
+            if (!enabled) { return true; }
+
+            float x0 = width, y0 = height, x1 = 0, y1 = 0, nearest = 1.0f;
+            for (int i = 0; i < 8; i++){
+                if (clip[i].w < nearW || clip[i].z < -clip[i].w) { return true; } // Crosses the near plane
+                glm::vec3 s = ToScreen(clip[i]);
+                x0 = std::min(x0, s.x); x1 = std::max(x1, s.x);
+                y0 = std::min(y0, s.y); y1 = std::max(y1, s.y);
+                nearest = std::min(nearest, s.z);
+            }
+            x0 = std::max(x0, 0.0f); y0 = std::max(y0, 0.0f);
+            x1 = std::min(x1, (float)width - 1); y1 = std::min(y1, (float)height - 1);
+            if (x0 > x1 || y0 > y1) { return true; }
+
+            // Level where the rectangle spans at most two texels each way
+            int level = 0;
+            float extent = std::max(x1 - x0, y1 - y0);
+            while (extent > 2.0f && level + 1 < (int)maxLevels.size()) { extent *= 0.5f; level++; }
+
+            int w = levelWidth[level], h = levelHeight[level];
+            int tx0 = std::min(w - 1, (int)x0 >> level), tx1 = std::min(w - 1, (int)x1 >> level);
+            int ty0 = std::min(h - 1, (int)y0 >> level), ty1 = std::min(h - 1, (int)y1 >> level);
+
+            float furthest = 0.0f, closest = 1.0f;
+            for (int y = ty0; y <= ty1; y++){
+                for (int x = tx0; x <= tx1; x++){
+                    furthest = std::max(furthest, maxLevels[level][x + w * y]);
+                    closest = std::min(closest, minLevels[level][x + w * y]);
+                }
+            }
+
+            // In front of everything drawn there, no need to compare further
+            if (nearest <= closest) { return true; }
+            if (nearest > furthest) { stats.occluded++; return false; }
+            return true;
+        }
+
+        // Frustum test that leaves the stats alone
+        static bool BoxInFrustum(const glm::mat4& viewProjection, glm::vec3 min, glm::vec3 max){
+            glm::vec4 clip[8];
+            for (int i = 0; i < 8; i++) { clip[i] = viewProjection * glm::vec4(Corner(min, max, i), 1.0f); }
+            return !OutsideFrustum(clip);
+        }
+
+        float CullRate(){
+            return stats.tested > 0 ? (float)(stats.frustumCulled + stats.occluded) / stats.tested : 0.0f;
+        }
+
+        float OcclusionRate(){
+            return stats.tested > 0 ? (float)stats.occluded / stats.tested : 0.0f;
+        }
+
+    private:
+        // Clip space w below this is treated as touching the camera
+        const float nearW = 1e-3f;
+
+        glm::mat4 viewProj = glm::mat4(1.0f);
+        glm::vec3 camPos = glm::vec3(0.0f);
+
+        // Level 0 of maxLevels is the depth buffer, depth runs 0 near to 1 far
+        std::vector< std::vector<float> > maxLevels;
+        std::vector< std::vector<float> > minLevels;
+        std::vector<int> levelWidth, levelHeight;
+
+        // Every corner outside the same clip plane
+        static bool OutsideFrustum(const glm::vec4* clip){
+            for (int plane = 0; plane < 6; plane++){
+                int axis = plane / 2;
+                float sign = (plane & 1) ? -1.0f : 1.0f;
+                bool outside = true;
+                for (int i = 0; i < 8 && outside; i++) { outside = sign * clip[i][axis] > clip[i].w; }
+                if (outside) { return true; }
+            }
+            return false;
+        }
+
+        static glm::vec3 Corner(glm::vec3 min, glm::vec3 max, int i){
+            return glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+        }
+
+        // Pixel coordinates with y down and depth mapped to 0-1
+        static glm::vec3 ToScreen(glm::vec4 clip){
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            return glm::vec3((ndc.x * 0.5f + 0.5f) * width, (0.5f - ndc.y * 0.5f) * height, ndc.z * 0.5f + 0.5f);
+        }
+
+        // Covers pixels whose centre is inside the triangle with its furthest depth
+        void RasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c){
+            float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+            if (area == 0.0f) { return; }
+            if (area < 0.0f) { std::swap(b, c); }
+
+            int minX = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+            int maxX = std::min(width - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+            int minY = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+            int maxY = std::min(height - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+            if (minX > maxX || minY > maxY) { return; }
+
+            float depth = std::min(1.0f, std::max(a.z, std::max(b.z, c.z)));
+
+            // Edge functions e = A * x + B * y + C, positive inside
+            float A[3] = { a.y - b.y, b.y - c.y, c.y - a.y };
+            float B[3] = { b.x - a.x, c.x - b.x, a.x - c.x };
+            float C[3] = { a.x * b.y - a.y * b.x, b.x * c.y - b.y * c.x, c.x * a.y - c.y * a.x };
+
+            float* buffer = maxLevels[0].data();
+            minX &= ~3; // Rows are processed four pixels at a time from an aligned start
+
+            for (int y = minY; y <= maxY; y++){
+                float py = y + 0.5f;
+                float* row = buffer + width * y;
+#if defined(__SSE2__)
+                __m128 depthV = _mm_set1_ps(depth);
+                __m128 zero = _mm_setzero_ps();
+                __m128 e[3], step[3];
+                for (int k = 0; k < 3; k++){
+                    float px = minX + 0.5f;
+                    e[k] = _mm_add_ps(_mm_set1_ps(B[k] * py + C[k]),
+                                      _mm_mul_ps(_mm_set1_ps(A[k]), _mm_setr_ps(px, px + 1, px + 2, px + 3)));
+                    step[k] = _mm_set1_ps(A[k] * 4.0f);
+                }
+                for (int x = minX; x <= maxX; x += 4){
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)), _mm_cmpge_ps(e[2], zero));
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 merged = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, depthV)), _mm_andnot_ps(inside, old));
+                    _mm_storeu_ps(row + x, merged);
+                    for (int k = 0; k < 3; k++) { e[k] = _mm_add_ps(e[k], step[k]); }
+                }
+#else
+                for (int x = minX; x <= maxX; x++){
+                    float px = x + 0.5f;
+                    if (A[0] * px + B[0] * py + C[0] >= 0.0f && A[1] * px + B[1] * py + C[1] >= 0.0f &&
+                            A[2] * px + B[2] * py + C[2] >= 0.0f){
+                        row[x] = std::min(row[x], depth);
+                    }
+                }
+#endif
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef RANDOMTICKS_H
+#define RANDOMTICKS_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#include "chunk.h"
+#include "workerpool.h"
+#include "blockregistry.h"
+#include "glm/glm.hpp"
+
+// xorshift64*, one state per thread seeded from the thread id and the clock,
+// so workers never share or lock a generator
+inline uint32_t TickRandom(){
+    static thread_local uint64_t state = (std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                                          (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count()) | 1;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (uint32_t)((state * 2685821657736338717ull) >> 32);
+}
+
+// A block a random tick wants changed
+struct BlockChange{
+    Chunk* chunk;
+    glm::ivec3 local;
+    unsigned int block;
+};
+
+// One section of a generated chunk with something to tick
+struct TickSection{
+    Chunk* chunk;
+    int section;
+};
+
+// Random block ticks, the slow changes of the world. Grass is the only
+// ticking block so far: covered by an opaque block it decays to dirt,
+// otherwise it spreads to a random neighbouring dirt block that is uncovered.
+//
+// Every section handed to Tick gets ticksPerSection blocks picked at random.
+// The world only hands over sections whose tickable counter (see
+// Chunk::TickableBlocks) is above zero, so the cost follows the sections with
+// something to tick rather than the number of voxels loaded. A section is one
+// contiguous slab of the voxel array and sections come chunk by chunk, so the
+// samples of a batch stay close together in memory.
+//
+// Sections are split into batches taken by the workers and the calling thread
+// alike. Ticks only read blocks and return the changes, which the world
+// applies afterwards, so batches are independent and need no locking even
+// when grass spreads across a section or chunk border.
+//
+// Chunks that are missing or still generating are left alone.
+class RandomTicker{
+    public:
+        std::function<Chunk*(int, int)> findChunk;
+
+        int ticksPerSection = 3;
+        int sectionsPerBatch = 64;
+
+        // Totals since the ticker was created
+        size_t sectionsTicked = 0, changesMade = 0;
+
+        RandomTicker(int cXS, int cYS, int cZS, WorkerPool* pool){
+            chunkXSize = cXS; chunkYSize = cYS; chunkZSize = cZS;
+            workers = pool;
+        }
+
+        // Samples every section and appends the wanted changes. Returns once
+        // all batches are done, the caller's thread works through them too so
+        // busy workers never hold it up for more than one batch.
+        void Tick(const std::vector<TickSection>& sections, std::vector<BlockChange>& changes){
+            if (sections.empty()) { return; }
+            std::shared_ptr<Batches> batches = std::make_shared<Batches>();
+            batches->sections = sections;
+            batches->count = (sections.size() + sectionsPerBatch - 1) / sectionsPerBatch;
+            batches->changes.resize(batches->count);
+
+            size_t helpers = std::min(workers->ThreadCount(), batches->count - 1);
+            for (size_t i = 0; i < helpers; i++){
+                workers->Submit([this, batches]{ Work(*batches); }, WorkerPool::High);
+            }
+            Work(*batches);
+            while (batches->done < batches->count) { std::this_thread::yield(); }
+
+            for (size_t b = 0; b < batches->count; b++){
+                changes.insert(changes.end(), batches->changes[b].begin(), batches->changes[b].end());
+            }
+            sectionsTicked += sections.size();
+        }
+
+    private:
+        int chunkXSize, chunkYSize, chunkZSize;
+        WorkerPool* workers;
+
+        // Shared with the helper jobs, which may only start after Tick has returned
+        struct Batches{
+            std::vector<TickSection> sections;
+            size_t count = 0;
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::vector< std::vector<BlockChange> > changes;
+        };
+
+        void Work(Batches& batches){
+            std::vector<Sample>& samples = SampleScratch();
+            size_t b;
+            while ((b = batches.next++) < batches.count){
+                size_t end = std::min(batches.sections.size(), (b + 1) * (size_t)sectionsPerBatch);
+                samples.clear();
+                for (size_t i = b * sectionsPerBatch; i < end; i++) { PickSamples(batches.sections[i], samples); }
+                for (size_t i = 0; i < samples.size(); i++){
+                    if (samples[i].chunk->GetAt(samples[i].local.x, samples[i].local.y, samples[i].local.z) == Blocks::Grass){
+                        TickGrass(samples[i].chunk, samples[i].local, batches.changes[b]);
+                    }
+                }
+                batches.done++;
+            }
+        }
+
+        struct Sample{
+            Chunk* chunk;
+            glm::ivec3 local;
+        };
+
+        static std::vector<Sample>& SampleScratch(){
+            static thread_local std::vector<Sample> samples;
+            return samples;
+        }
+
+        // Picks the blocks to tick and prefetches them, a random block is
+        // nearly always a cache miss, so a batch's misses overlap instead of
+        // being paid one after another
+        void PickSamples(const TickSection& target, std::vector<Sample>& samples){
+            int bottom = target.section * Chunk::sectionSize;
+            int height = std::min(Chunk::sectionSize, chunkYSize - bottom);
+            const unsigned int* blocks = target.chunk->BlockData();
+            for (int t = 0; t < ticksPerSection; t++){
+                uint32_t r = TickRandom();
+                glm::ivec3 local = glm::ivec3(r % chunkXSize, bottom + (r >> 8) % height, (r >> 16) % chunkZSize);
+                __builtin_prefetch(blocks + target.chunk->BlockIndex(local));
+                samples.push_back(Sample{ target.chunk, local });
+            }
+        }
+
+        void TickGrass(Chunk* ch, glm::ivec3 local, std::vector<BlockChange>& changes){
+            if (BlockRegistry::Opaque(GetBlock(ch, local + glm::ivec3(0, 1, 0)))){
+                changes.push_back(BlockChange{ ch, local, Blocks::Dirt });
+                return;
+            }
+
+            uint32_t r = TickRandom();
+            glm::ivec3 spread = local + glm::ivec3((int)(r % 3) - 1, (int)((r >> 8) % 3) - 1, (int)((r >> 16) % 3) - 1);
+            Chunk* target = Locate(ch, spread);
+            if (target == nullptr || target->GetAt(spread.x, spread.y, spread.z) != Blocks::Dirt) { return; }
+            if (BlockRegistry::Opaque(GetBlock(target, spread + glm::ivec3(0, 1, 0)))) { return; }
+            changes.push_back(BlockChange{ target, spread, Blocks::Grass });
+        }
+
+        // Open sky above the world, and anything unknown counts as covered
+        unsigned int GetBlock(Chunk* ch, glm::ivec3 local){
+            if (local.y >= chunkYSize) { return Blocks::Air; }
+            ch = Locate(ch, local);
+            return ch != nullptr ? ch->GetAt(local.x, local.y, local.z) : Blocks::Stone;
+        }
+
+        // Chunk holding a position given relative to ch, with local made
+        // relative to that chunk. Only looks the chunk up when it is not ch.
+        Chunk* Locate(Chunk* ch, glm::ivec3& local){
+            if (local.y < 0 || local.y >= chunkYSize) { return nullptr; }
+            if (local.x >= 0 && local.x < chunkXSize && local.z >= 0 && local.z < chunkZSize) { return ch; }
+
+            int dx = local.x < 0 ? -1 : (local.x >= chunkXSize ? 1 : 0);
+            int dz = local.z < 0 ? -1 : (local.z >= chunkZSize ? 1 : 0);
+            Chunk* neighbour = findChunk(ch->xCoord + dx, ch->zCoord + dz);
+            if (neighbour == nullptr) { return nullptr; }
+            unsigned int state = neighbour->chunkState;
+            if (state != 2 && state != 3) { return nullptr; }
+            local.x -= dx * chunkXSize;
+            local.z -= dz * chunkZSize;
+            return neighbour;
+        }
+};
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef REGIONSTORE_H
+#define REGIONSTORE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rle.h"
+
+// Chunks are persisted in region files of 32x32 chunks. A region file starts
+// with a fixed header holding a table of (offset, length) pairs, one per chunk,
+// followed by RLE compressed payloads. Reads go through a shared mapping of the
+// whole file so loading a chunk is a page fault and a decode.
+//
+// Loads look chunks up in an in-memory copy of the offset table rather than
+// the one on disk. A batch publishes its entries there only once its writes
+// have landed, so loads never wait on a write or see a half written payload.
+//
+// Header:  uint32 magic, uint32 version, uint32 entries[1024][2]
+// Payload: uint32 voxel count, RLE bytes
+class RegionStore{
+    protected:
+        struct Region;
+
+    public:
+        static const int regionSize = 32;
+        static const uint32_t magic = 0x47524742; // "BGRG"
+        static const uint32_t version = 1;
+        static const size_t tableSize = regionSize * regionSize * 8;
+        static const size_t headerSize = 8 + tableSize;
+
+        // A set of payloads for one region turned into a single append plus a
+        // rewrite of the offset table. Other writers to the region wait until
+        // EndBatch, loads do not.
+        struct RegionBatch{
+            Region* region = nullptr;
+            std::unique_lock<std::mutex> guard;
+            int fd = -1;
+            size_t offset = 0;
+            std::vector<unsigned char> data;
+            std::vector<unsigned char> table;
+            std::vector<int> indices;
+        };
+
+        RegionStore(std::string dir, size_t voxels){
+            directory = dir;
+            voxelCount = voxels;
+            mkdir(directory.c_str(), 0755);
+        }
+
+        ~RegionStore(){
+            for (auto& it : regions) {
+                Region* r = it.second;
+                if (r->map != nullptr) { munmap(r->map, r->mapSize); }
+                if (r->fd != -1) { close(r->fd); }
+                delete r;
+            }
+        }
+
+        // Answered from an in-memory copy of the offset table, so it never waits
+        // on a region that is being written
+        bool Contains(int xCoord, int zCoord){
+            Region* r = GetRegion(RegionCoord(xCoord), RegionCoord(zCoord), false);
+            if (r == nullptr) { return false; }
+
+            std::lock_guard<std::mutex> guard(r->indexLock);
+            return r->entries[LocalIndex(xCoord, zCoord)][1] > 0;
+        }
+
+        bool Load(int xCoord, int zCoord, unsigned int* out){
+            Region* r = GetRegion(RegionCoord(xCoord), RegionCoord(zCoord), false);
+            if (r == nullptr) { return false; }
+
+            uint32_t offset, length;
+            ReadEntry(r, LocalIndex(xCoord, zCoord), offset, length);
+            if (length < 4) { return false; }
+
+            std::lock_guard<std::mutex> guard(r->lock);
+            if (offset + length > r->mapSize && !Remap(r)) { return false; }
+            if (offset + length > r->mapSize) { return false; }
+
+            const unsigned char* payload = r->map + offset;
+            uint32_t count;
+            std::memcpy(&count, payload, 4);
+            if (count != voxelCount || !RLE::Decode(payload + 4, length - 4, out, voxelCount)){
+                std::cout << "ERROR::REGIONSTORE::CORRUPT_CHUNK " << xCoord << " " << zCoord << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        bool Save(int xCoord, int zCoord, const unsigned int* data){
+            std::vector<unsigned char> payload;
+            Encode(data, payload);
+            return Write(xCoord, zCoord, payload);
+        }
+
+        void Encode(const unsigned int* data, std::vector<unsigned char>& payload){
+            uint32_t count = static_cast<uint32_t>(voxelCount);
+            payload.resize(4);
+            std::memcpy(payload.data(), &count, 4);
+            RLE::Encode(data, voxelCount, payload);
+        }
+
+        // Appends an encoded payload to the chunk's region file and repoints its
+        // header entry. Superseded payloads are left behind in the file.
+        bool Write(int xCoord, int zCoord, const std::vector<unsigned char>& payload){
+            std::vector< std::pair<int, const std::vector<unsigned char>*> > payloads;
+            payloads.push_back(std::make_pair(LocalIndex(xCoord, zCoord), &payload));
+
+            RegionBatch batch;
+            if (!BeginBatch(RegionCoord(xCoord), RegionCoord(zCoord), payloads, batch)) { return false; }
+
+            bool ok = pwrite(batch.fd, batch.data.data(), batch.data.size(), batch.offset) == (ssize_t)batch.data.size() &&
+                      pwrite(batch.fd, batch.table.data(), tableSize, 8) == (ssize_t)tableSize;
+            EndBatch(batch, ok);
+            return ok;
+        }
+
+        // payloads pairs a LocalIndex with its encoded chunk. The caller issues
+        // the two writes (data at offset, table at byte 8) then calls EndBatch.
+        bool BeginBatch(int rx, int rz, const std::vector< std::pair<int, const std::vector<unsigned char>*> >& payloads, RegionBatch& batch){
+            Region* r = GetRegion(rx, rz, true);
+            if (r == nullptr) { return false; }
+
+            batch.region = r;
+            batch.guard = std::unique_lock<std::mutex>(r->writeLock);
+            batch.fd = r->fd;
+            batch.offset = r->fileSize;
+
+            batch.table.resize(tableSize);
+            {
+                std::lock_guard<std::mutex> guard(r->indexLock);
+                std::memcpy(batch.table.data(), r->entries, tableSize);
+            }
+
+            size_t total = 0;
+            for (size_t i = 0; i < payloads.size(); i++) { total += payloads[i].second->size(); }
+            batch.data.clear();
+            batch.data.reserve(total);
+
+            for (size_t i = 0; i < payloads.size(); i++) {
+                const std::vector<unsigned char>& payload = *payloads[i].second;
+                uint32_t entry[2] = { static_cast<uint32_t>(batch.offset + batch.data.size()), static_cast<uint32_t>(payload.size()) };
+                std::memcpy(batch.table.data() + payloads[i].first * 8, entry, 8);
+                batch.data.insert(batch.data.end(), payload.begin(), payload.end());
+                batch.indices.push_back(payloads[i].first);
+            }
+            return true;
+        }
+
+        void EndBatch(RegionBatch& batch, bool written){
+            Region* r = batch.region;
+            if (r == nullptr) { return; }
+
+            if (written){
+                r->fileSize = batch.offset + batch.data.size();
+                std::lock_guard<std::mutex> guard(r->indexLock);
+                for (size_t i = 0; i < batch.indices.size(); i++) {
+                    std::memcpy(r->entries[batch.indices[i]], batch.table.data() + batch.indices[i] * 8, 8);
+                }
+            }
+            if (batch.guard.owns_lock()) { batch.guard.unlock(); }
+            batch.region = nullptr;
+        }
+
+        static int RegionCoord(int chunkCoord){
+            return chunkCoord >= 0 ? chunkCoord / regionSize : (chunkCoord - regionSize + 1) / regionSize;
+        }
+
+        static int LocalIndex(int xCoord, int zCoord){
+            return (xCoord - RegionCoord(xCoord) * regionSize) + (zCoord - RegionCoord(zCoord) * regionSize) * regionSize;
+        }
+
+    protected:
+        struct Region{
+            int fd = -1;
+            unsigned char* map = nullptr;
+            size_t mapSize = 0;
+            bool missing = false;
+
+            // writeLock is held by a batch from BeginBatch to EndBatch, across
+            // the disk writes, and guards fileSize. Loads never take it.
+            std::mutex writeLock;
+            size_t fileSize = 0;
+
+            // lock guards the mapping, indexLock the table entries. Neither is
+            // ever held while waiting on a write.
+            std::mutex lock;
+            std::mutex indexLock;
+            uint32_t entries[regionSize * regionSize][2] = {};
+        };
+
+        std::string directory;
+        size_t voxelCount;
+
+        std::map< std::pair<int, int>, Region*> regions;
+        std::mutex regionsLock;
+
+        std::string RegionPath(int rx, int rz){
+            return directory + "/r." + std::to_string(rx) + "." + std::to_string(rz) + ".bin";
+        }
+
+        // Missing regions are cached as well so that repeated lookups in
+        // unexplored terrain do not keep hitting the filesystem
+        Region* GetRegion(int rx, int rz, bool create){
+            std::lock_guard<std::mutex> guard(regionsLock);
+            std::pair<int, int> key (rx, rz);
+
+            Region* r = regions[key];
+            if (r == nullptr){
+                r = new Region();
+                regions[key] = r;
+            }
+            if (r->fd != -1) { return r; }
+            if (r->missing && !create) { return nullptr; }
+
+            std::lock_guard<std::mutex> regionGuard(r->lock);
+            r->missing = !Open(r, RegionPath(rx, rz), create);
+            return r->missing ? nullptr : r;
+        }
+
+        bool Open(Region* r, const std::string& path, bool create){
+            int fd = open(path.c_str(), create ? (O_RDWR | O_CREAT) : O_RDWR, 0644);
+            if (fd == -1) { return false; }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) { close(fd); return false; }
+            size_t size = static_cast<size_t>(st.st_size);
+
+            if (size == 0){
+                if (!create) { close(fd); return false; }
+                std::vector<unsigned char> header(headerSize, 0);
+                std::memcpy(header.data(), &magic, 4);
+                std::memcpy(header.data() + 4, &version, 4);
+                if (pwrite(fd, header.data(), headerSize, 0) != (ssize_t)headerSize) { close(fd); return false; }
+                size = headerSize;
+            }
+
+            uint32_t fileMagic = 0, fileVersion = 0;
+            if (size < headerSize || pread(fd, &fileMagic, 4, 0) != 4 || pread(fd, &fileVersion, 4, 4) != 4 ||
+                    fileMagic != magic || fileVersion != version){
+                std::cout << "ERROR::REGIONSTORE::BAD_HEADER " << path << std::endl;
+                close(fd);
+                return false;
+            }
+
+            std::vector<unsigned char> table(tableSize);
+            if (pread(fd, table.data(), tableSize, 8) != (ssize_t)tableSize) { close(fd); return false; }
+            {
+                std::lock_guard<std::mutex> guard(r->indexLock);
+                std::memcpy(r->entries, table.data(), tableSize);
+            }
+
+            r->fd = fd;
+            r->fileSize = size;
+            return Remap(r);
+        }
+
+        // Maps the file as far as it reaches now, which may include a batch
+        // still being appended, its entries are not published yet
+        bool Remap(Region* r){
+            struct stat st;
+            if (fstat(r->fd, &st) != 0) { return false; }
+            size_t size = static_cast<size_t>(st.st_size);
+
+            if (r->map != nullptr) { munmap(r->map, r->mapSize); r->map = nullptr; r->mapSize = 0; }
+
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, r->fd, 0);
+            if (mapped == MAP_FAILED) { return false; }
+            r->map = static_cast<unsigned char*>(mapped);
+            r->mapSize = size;
+            return true;
+        }
+
+        void ReadEntry(Region* r, int index, uint32_t& offset, uint32_t& length){
+            std::lock_guard<std::mutex> guard(r->indexLock);
+            offset = r->entries[index][0];
+            length = r->entries[index][1];
+        }
+};
+
+#endif
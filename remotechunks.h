@@ -0,0 +1,122 @@
+#ifndef REMOTECHUNKS_H
+#define REMOTECHUNKS_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <functional>
+
+#include "netprotocol.h"
+
+// Client side of the chunk server. Requests and the edits queued since the
+// last Poll go out with the next one, which also hands over every chunk and
+// edit that has arrived. Never blocks, so it is polled from the world's tick.
+class RemoteChunkSource{
+    public:
+        struct Stats{
+            size_t requested;
+            size_t received;
+            size_t bytesReceived;
+            size_t editsSent;
+            size_t editsReceived;
+        };
+
+        Stats stats = {};
+
+        // Requested and not yet received
+        std::set< std::pair<int, int> > outstanding;
+
+        RemoteChunkSource(size_t voxels){ voxelCount = voxels; }
+
+        ~RemoteChunkSource(){ delete conn; }
+
+        bool Connect(const std::string& address){
+            int fd = NetAddress::Connect(address);
+            if (fd == -1) { return false; }
+            conn = new Connection(fd);
+            uint32_t encodings = ChunkCodec::Supported();
+            conn->Send(MessageType::Hello, &encodings, sizeof(encodings));
+            return true;
+        }
+
+        bool Connected(){ return conn != nullptr && conn->Open(); }
+
+        void Request(int xCoord, int zCoord){
+            int32_t coords[2] = { xCoord, zCoord };
+            conn->Send(MessageType::ChunkRequest, coords, sizeof(coords));
+            outstanding.insert(std::pair<int, int>(xCoord, zCoord));
+            stats.requested++;
+        }
+
+        // Tells the server a received chunk was unloaded, it then stops sending
+        // its edits until the chunk is requested again
+        void Forget(int xCoord, int zCoord){
+            if (!Connected()) { return; }
+            int32_t coords[2] = { xCoord, zCoord };
+            conn->Send(MessageType::ChunkForget, coords, sizeof(coords));
+        }
+
+        // Block index as in Chunk::BlockIndex, sent with the next Poll
+        void QueueEdit(int xCoord, int zCoord, unsigned int index, unsigned int block){
+            edits.Add(xCoord, zCoord, index, block);
+        }
+
+        // Sends queued requests and edits, then passes each chunk that has
+        // arrived to onChunk and each edit made by another client to onEdit.
+        // False once the connection is lost.
+        bool Poll(const std::function<void(int, int, const unsigned int*)>& onChunk,
+                  const std::function<void(int, int, unsigned int, unsigned int)>& onEdit){
+            if (!Connected()) { return false; }
+            if (!edits.Empty()){
+                std::vector<unsigned char> body;
+                edits.Encode(body);
+                conn->Send(MessageType::BlockDeltas, body.data(), body.size());
+                stats.editsSent += edits.Edits();
+                edits.Clear();
+            }
+            conn->Flush();
+            conn->Receive();
+
+            Message message;
+            while (conn->Next(message)){
+                if (message.type == MessageType::BlockDeltas){
+                    bool valid = DeltaBatch::Decode(message.body.data(), message.body.size(), [&](int x, int z, unsigned int index, unsigned int block){
+                        if (index >= voxelCount) { return; }
+                        stats.editsReceived++;
+                        onEdit(x, z, index, block);
+                    });
+                    if (!valid) { std::cout << "ERROR::NET::BAD_DELTAS" << std::endl; }
+                    stats.bytesReceived += Connection::headerSize + message.body.size();
+                    continue;
+                }
+                if (message.type != MessageType::ChunkData) { continue; }
+                const size_t header = 12;
+                int32_t fields[3];
+                if (message.body.size() < header) { continue; }
+                std::memcpy(fields, message.body.data(), header);
+
+                blocks.resize(voxelCount);
+                if (!ChunkCodec::Decode(message.body.data() + header, message.body.size() - header, (uint32_t)fields[2], blocks.data(), voxelCount)){
+                    std::cout << "ERROR::NET::BAD_CHUNK " << fields[0] << " " << fields[1] << std::endl;
+                    continue;
+                }
+
+                outstanding.erase(std::pair<int, int>(fields[0], fields[1]));
+                stats.received++;
+                stats.bytesReceived += Connection::headerSize + message.body.size();
+                onChunk(fields[0], fields[1], blocks.data());
+            }
+            return Connected();
+        }
+
+    private:
+        Connection* conn = nullptr;
+        size_t voxelCount;
+        std::vector<unsigned int> blocks;
+        DeltaBatch edits;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "world.h"
+#include "chunk.h"
+#include "chunkgpu.h"
+#include "shader.h"
+#include "camera.h"
+#include "visibility.h"
+#include "occlusion.h"
+#include "drawqueue.h"
+#include "telemetry.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Draws a World. Everything that needs a GL context lives here and in
+// ChunkGpu, so the world can tick, generate and mesh without one. Meshed
+// chunks are uploaded the first frame they are in range and remeshed sections
+// are patched in as the world applies them.
+class WorldRenderer{
+    public:
+        static const int chunkXSize = World::chunkXSize, chunkYSize = World::chunkYSize, chunkZSize = World::chunkZSize;
+
+        World* world;
+        VisibilityGraph* visibility;
+        OcclusionCuller* occlusion;
+        DrawQueue drawQueue;
+
+        // Chunks this close to the camera are occluders, further ones are tested
+        int occluderDistance = 3;
+
+        WorldRenderer(World* w){
+            world = w;
+
+            visibility = new VisibilityGraph(chunkXSize, chunkYSize, chunkZSize);
+            visibility->findChunk = [w](int x, int z){ return w->FindChunk(x, z); };
+
+            occlusion = new OcclusionCuller();
+        }
+
+        // Chunk buffers belong to the chunks and go with the world
+        ~WorldRenderer(){
+            delete occlusion;
+            delete visibility;
+        }
+
+        // Uploads finished meshes and draws what survives culling. Only touches
+        // chunks the world's Tick has already created.
+        void Draw(Shader& shader, Camera* cam, const glm::mat4& viewProjection){
+            int camXCoord = cam->position.x / chunkXSize;
+            int camZCoord = cam->position.z / chunkZSize;
+            int renderDistance = world->renderDistance;
+
+            world->CountReadiness(viewProjection, cam->position);
+
+            visibility->Update(cam->position, camXCoord, camZCoord, renderDistance);
+            BuildOccluders(cam, camXCoord, camZCoord, viewProjection);
+
+            drawQueue.Clear();
+            drawQueue.maxDistance = (renderDistance + 2) * std::sqrt((float)(chunkXSize * chunkXSize + chunkYSize * chunkYSize + chunkZSize * chunkZSize));
+
+            for (int z = camZCoord - renderDistance; z < camZCoord + renderDistance + 1; z++) {
+                for (int x = camXCoord - renderDistance; x < camXCoord + renderDistance + 1; x++) {
+                    Chunk* ch = world->FindChunk(x, z);
+                    if (ch == nullptr) { continue; }
+
+                    if (ch->chunkState == 2){
+                        Upload(ch);
+                    }
+                    else if (ch->chunkState == 3){
+                        if (ch->staleGpuSections != 0){
+                            static_cast<ChunkGpu*>(ch->gpu)->Update(ch->GetMesh(), ch->staleGpuSections);
+                            ch->staleGpuSections = 0;
+                        }
+
+                        unsigned int sections = CullSections(ch, visibility->Visible(x, z), std::max(std::abs(x - camXCoord), std::abs(z - camZCoord)));
+                        if (sections == 0) { continue; }
+
+                        drawQueue.Add(ch, sections, DistanceToChunk(cam->position, ch));
+                    }
+                }
+            }
+
+            // Nearest first so the depth test rejects what they hide
+            drawQueue.SortFrontToBack();
+            PipelineTelemetry* telemetry = world->telemetry;
+            for (size_t i = 0; i < drawQueue.entries.size(); i++){
+                Chunk* ch = drawQueue.entries[i].chunk;
+
+                glm::mat4 model = glm::mat4(1.0f);
+                model = glm::translate(model, glm::vec3(ch->xCoord * chunkXSize,0,ch->zCoord * chunkZSize));
+                shader.setMat4("model", model);
+
+                glm::vec3 eye = cam->position - glm::vec3(ch->xCoord * chunkXSize, 0, ch->zCoord * chunkZSize);
+                static_cast<ChunkGpu*>(ch->gpu)->Draw(ch->GetMesh(), ch->mesher, drawQueue.entries[i].sections, eye);
+
+                if (ch->timeline.firstDrawn == 0.0){
+                    ch->timeline.firstDrawn = PipelineTelemetry::Now();
+                    telemetry->Record(PipelineStage::FirstDraw, ch->timeline.uploaded, ch->timeline.firstDrawn);
+                    telemetry->Record(PipelineStage::RequestToDrawn, ch->timeline.requested, ch->timeline.firstDrawn);
+                    telemetry->Count(PipelineEvent::Drawn);
+                }
+            }
+        }
+
+        // Gives a generated chunk its buffers, also used again for chunks the
+        // cache took the buffers from
+        void Upload(Chunk* ch){
+            ChunkGpu* gpu = new ChunkGpu();
+            gpu->Upload(ch->GetMesh());
+            ch->gpu = gpu;
+            ch->staleGpuSections = 0;
+
+            // Uploads after the cache released the buffers are not part of the pipeline
+            if (ch->timeline.uploaded == 0.0){
+                ch->timeline.uploaded = PipelineTelemetry::Now();
+                world->telemetry->Record(PipelineStage::UploadWait, ch->timeline.meshed, ch->timeline.uploaded);
+                world->telemetry->Count(PipelineEvent::Uploaded);
+            }
+            ch->chunkState = 3;
+        }
+
+        // Distance from a point to the nearest point of a chunk's bounds
+        float DistanceToChunk(glm::vec3 pos, Chunk* ch){
+            glm::vec3 min = glm::vec3(ch->xCoord * chunkXSize, 0, ch->zCoord * chunkZSize);
+            glm::vec3 max = min + glm::vec3(chunkXSize, chunkYSize, chunkZSize);
+            return glm::length(glm::clamp(pos, min, max) - pos);
+        }
+
+        // Rasterizes the solid base of every meshed chunk near the camera
+        void BuildOccluders(Camera* cam, int camX, int camZ, const glm::mat4& viewProjection){
+            occlusion->Begin(viewProjection, cam->position);
+            for (int z = camZ - occluderDistance; z <= camZ + occluderDistance; z++){
+                for (int x = camX - occluderDistance; x <= camX + occluderDistance; x++){
+                    Chunk* ch = world->FindChunk(x, z);
+                    if (ch == nullptr || ch->chunkState != 3) { continue; }
+
+                    int height = ch->OccluderHeight();
+                    if (height == 0) { continue; }
+                    glm::vec3 min = glm::vec3(x * chunkXSize, 0, z * chunkZSize);
+                    occlusion->AddOccluder(min, min + glm::vec3(chunkXSize, height, chunkZSize));
+                }
+            }
+            occlusion->Finish();
+        }
+
+        // Drops sections outside the frustum, and beyond the occluders also
+        // those hidden behind them
+        unsigned int CullSections(Chunk* ch, unsigned int sections, int distance){
+            for (int s = 0; s < ch->SectionCount(); s++){
+                if ((sections & (1u << s)) == 0) { continue; }
+
+                glm::vec3 min = glm::vec3(ch->xCoord * chunkXSize, s * Chunk::sectionSize, ch->zCoord * chunkZSize);
+                glm::vec3 max = glm::vec3(min.x + chunkXSize, std::min((s + 1) * Chunk::sectionSize, (int)chunkYSize), min.z + chunkZSize);
+                bool visible = distance > occluderDistance ? occlusion->Visible(min, max) : occlusion->InFrustum(min, max);
+                if (!visible) { sections &= ~(1u << s); }
+            }
+            return sections;
+        }
+};
+
+#endif
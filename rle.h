@@ -0,0 +1,54 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <vector>
+#include <cstddef>
+
+// Run length coding for voxel arrays. Each run is stored as two LEB128
+// varints, run length then value, which suits the layered terrain well.
+namespace RLE{
+    inline void PutVarint(std::vector<unsigned char>& out, unsigned int value){
+        while (value >= 0x80){
+            out.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    inline bool GetVarint(const unsigned char*& in, const unsigned char* end, unsigned int& value){
+        value = 0;
+        for (int shift = 0; shift < 35 && in < end; shift += 7){
+            unsigned char byte = *in++;
+            value |= static_cast<unsigned int>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) { return true; }
+        }
+        return false;
+    }
+
+    inline void Encode(const unsigned int* data, size_t count, std::vector<unsigned char>& out){
+        size_t i = 0;
+        while (i < count){
+            unsigned int value = data[i];
+            size_t run = 1;
+            while (i + run < count && data[i + run] == value) { run++; }
+            PutVarint(out, static_cast<unsigned int>(run));
+            PutVarint(out, value);
+            i += run;
+        }
+    }
+
+    // Returns false if the input is truncated or does not decode to exactly count values
+    inline bool Decode(const unsigned char* in, size_t size, unsigned int* data, size_t count){
+        const unsigned char* end = in + size;
+        size_t i = 0;
+        while (in < end){
+            unsigned int run, value;
+            if (!GetVarint(in, end, run) || !GetVarint(in, end, value)) { return false; }
+            if (run > count - i) { return false; }
+            for (unsigned int r = 0; r < run; r++) { data[i++] = value; }
+        }
+        return i == count;
+    }
+}
+
+#endif
@@ -0,0 +1,77 @@
+// Headless chunk server. Generates terrain with the game's own chunk code and
+// streams it to any number of clients, see chunkserver.h. Built by
+// "make server", needs no GL:
+//
+//     ./Server.exe [--listen unix:blockgame.sock | host:port] [--threads n] [--budget MB] [--seconds n]
+//
+// Runs until interrupted, or for --seconds, and prints throughput every few
+// seconds.
+
+#include "chunkserver.h"
+#include "memstats.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iostream>
+
+volatile std::sig_atomic_t running = 1;
+
+void stop(int){ running = 0; }
+
+int main(int argc, char** argv){
+    std::string address = "unix:blockgame.sock";
+    unsigned int threads = WorkerPool::DefaultThreadCount();
+    size_t budget = 0;
+    double seconds = 0.0;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "--listen") == 0 && i + 1 < argc) { address = argv[++i]; }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { threads = std::atoi(argv[++i]); }
+        else if (std::strcmp(argv[i], "--budget") == 0 && i + 1 < argc) { budget = (size_t)std::atoi(argv[++i]) * 1024 * 1024; }
+        else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) { seconds = std::atof(argv[++i]); }
+    }
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    ChunkServer* server = new ChunkServer(threads);
+    if (budget > 0) { server->memoryBudget = budget; }
+    if (!server->Listen(address)) { delete server; return 1; }
+    std::cout << "Serving chunks on " << address << " with " << threads << " worker threads" << std::endl;
+
+    const double reportInterval = 5.0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double lastReport = 0.0, elapsed = 0.0;
+    ChunkServer::Stats last = {};
+    while (running && (seconds <= 0.0 || elapsed < seconds)){
+        server->Poll(100);
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (elapsed - lastReport >= reportInterval){
+            ChunkServer::Stats now = server->stats;
+            double interval = elapsed - lastReport;
+            std::cout << "Clients " << server->ClientCount() << ", served " << (now.served - last.served) / interval
+                      << " chunks/s, generated " << (now.generated - last.generated) / interval << " chunks/s, "
+                      << (now.bytesSent - last.bytesSent) / interval / (1024.0 * 1024.0) << " MB/s, generating "
+                      << server->Generating() << ", cached " << server->CachedChunks() << ", "
+                      << server->telemetry->Summary(PipelineStage::Generation) << std::endl;
+            last = now;
+            lastReport = elapsed;
+        }
+    }
+
+    ChunkServer::Stats stats = server->stats;
+    std::cout << "Served " << stats.served << " chunks to " << stats.clientsAccepted << " clients in " << elapsed << " s ("
+              << stats.served / elapsed << " chunks/s), generated " << stats.generated << ", requests " << stats.requests
+              << ", from cache " << stats.cacheHits << ", shared " << stats.shared << ", hit rate " << server->HitRate() * 100.0f
+              << "%, evicted " << stats.evictions << ", sent " << stats.bytesSent / (1024 * 1024) << " MB, edits received "
+              << stats.editsReceived << ", forwarded " << stats.editsForwarded << ", forgotten " << stats.forgotten << std::endl;
+    std::cout << "Server p50/p95/p99 " << server->telemetry->Summary(PipelineStage::QueueWait) << ", "
+              << server->telemetry->Summary(PipelineStage::Generation) << std::endl;
+
+    delete server;
+    std::cout << "Memory after shutdown MB " << MemoryStats::Summary() << std::endl;
+    return 0;
+}
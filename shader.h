@@ -5,17 +5,24 @@
 #include "glm/glm.hpp"
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdint>
+#include <sys/stat.h>
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // true when the program was loaded from the binary cache rather than compiled
+    bool fromCache = false;
+    // constructor generates the shader on the fly. Linked programs are saved to
+    // cacheDirectory with glGetProgramBinary and loaded back on the next launch,
+    // pass nullptr to always compile from source.
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* cacheDirectory = "ShaderCache")
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -45,9 +52,19 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
         }
+        // 2. try the program binary saved by an earlier launch
+        bool cacheSupported = cacheDirectory != nullptr && BinariesSupported();
+        std::string cachePath;
+        if (cacheSupported)
+        {
+            cachePath = std::string(cacheDirectory) + "/" + CacheKey(vertexCode, fragmentCode) + ".bin";
+            fromCache = LoadBinary(cachePath);
+            if (fromCache)
+                return;
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -61,6 +78,8 @@ public:
         checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
         ID = glCreateProgram();
+        if (cacheSupported)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         glLinkProgram(ID);
@@ -68,7 +87,12 @@ public:
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-
+        // 4. save the linked program for the next launch
+        if (cacheSupported)
+        {
+            mkdir(cacheDirectory, 0755);
+            SaveBinary(cachePath);
+        }
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -136,6 +160,102 @@ public:
     }
 
 private:
+    // header written in front of each cached binary
+    // ------------------------------------------------------------------------
+    struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t format;
+        uint32_t length;
+    };
+    static const uint32_t cacheMagic = 0x43534742; // "BGSC"
+
+    // program binaries are an optional GL 4.1 feature, and drivers may offer no formats
+    // ------------------------------------------------------------------------
+    static bool BinariesSupported()
+    {
+        if (glGetProgramBinary == NULL || glProgramBinary == NULL || glProgramParameteri == NULL)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+    // FNV-1a over the sources and the driver strings, so editing a shader or
+    // updating the driver gives a new file name and the stale binary is never read
+    // ------------------------------------------------------------------------
+    static std::string CacheKey(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const char* text)
+        {
+            for (const char* c = text != NULL ? text : ""; ; c++)
+            {
+                hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+                if (*c == '\0')
+                    break;
+            }
+        };
+        mix(vertexCode.c_str());
+        mix(fragmentCode.c_str());
+        mix((const char*)glGetString(GL_VENDOR));
+        mix((const char*)glGetString(GL_RENDERER));
+        mix((const char*)glGetString(GL_VERSION));
+
+        static const char digits[] = "0123456789abcdef";
+        std::string key(16, '0');
+        for (int i = 15; i >= 0; i--, hash >>= 4)
+            key[i] = digits[hash & 15];
+        return key;
+    }
+    // ------------------------------------------------------------------------
+    bool LoadBinary(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        CacheHeader header;
+        if (!file.read((char*)&header, sizeof(header)) || header.magic != cacheMagic || header.length == 0)
+            return false;
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), binary.size()))
+            return false;
+
+        ID = glCreateProgram();
+        glProgramBinary(ID, header.format, binary.data(), (GLsizei)binary.size());
+        // the driver rejects binaries it can no longer use, compile from source instead
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(ID);
+            ID = 0;
+            return false;
+        }
+        return true;
+    }
+    // ------------------------------------------------------------------------
+    void SaveBinary(const std::string& path)
+    {
+        GLint success = 0, length = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!success || length <= 0)
+            return;
+        std::vector<char> binary(length);
+        CacheHeader header = { cacheMagic, 0, 0 };
+        GLsizei written = 0;
+        glGetProgramBinary(ID, length, &written, &header.format, binary.data());
+        header.length = (uint32_t)written;
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::CACHE_NOT_WRITTEN: " << path << std::endl;
+            return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), written);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,192 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+// Intervals of the chunk pipeline that are timed
+namespace PipelineStage {
+    enum : int {
+        Scheduling,         // requested until queued on the worker pool
+        QueueWait,          // queued until a worker starts generating
+        Generation,         // voxels and light
+        Meshing,
+        UploadWait,         // meshed until the render thread uploads it
+        FirstDraw,          // uploaded until first drawn
+        RequestToMeshed,    // whole CPU side, the useful total in headless runs
+        RequestToDrawn,
+        Count
+    };
+}
+
+constexpr const char* pipelineStageNames[PipelineStage::Count] = {
+    "scheduling", "queue_wait", "generation", "meshing", "upload_wait", "first_draw", "request_to_meshed", "request_to_drawn"
+};
+
+// Points in the pipeline counted for throughput
+namespace PipelineEvent {
+    enum : int { Requested, Meshed, Uploaded, Drawn, Count };
+}
+
+constexpr const char* pipelineEventNames[PipelineEvent::Count] = { "requested", "meshed", "uploaded", "drawn" };
+
+// When each step happened to one chunk, in PipelineTelemetry::Now seconds.
+// Zero means the step has not happened.
+struct ChunkTimeline{
+    double requested = 0.0;
+    double queued = 0.0;
+    double generationStarted = 0.0;
+    double generated = 0.0;
+    double meshed = 0.0;
+    double uploaded = 0.0;
+    double firstDrawn = 0.0;
+};
+
+// Log scale histogram with eight buckets per doubling from 1 us, so any
+// percentile is within about 9% and memory stays fixed however long the run
+class LatencyHistogram{
+    public:
+        static const int bucketsPerDoubling = 8;
+        static const int bucketCount = 40 * bucketsPerDoubling;
+
+        void Add(double seconds){
+            double micros = std::max(0.0, seconds * 1e6);
+            int bucket = micros <= 1.0 ? 0 : (int)(std::log2(micros) * bucketsPerDoubling);
+            bucket = std::min(bucketCount - 1, bucket);
+            counts[bucket].fetch_add(1, std::memory_order_relaxed);
+            samples.fetch_add(1, std::memory_order_relaxed);
+            totalMicros.fetch_add((uint64_t)micros, std::memory_order_relaxed);
+
+            uint64_t m = maxMicros.load(std::memory_order_relaxed);
+            while ((uint64_t)micros > m && !maxMicros.compare_exchange_weak(m, (uint64_t)micros, std::memory_order_relaxed)) {}
+        }
+
+        uint64_t Samples(){ return samples.load(std::memory_order_relaxed); }
+
+        double MeanSeconds(){
+            uint64_t n = Samples();
+            return n > 0 ? totalMicros.load(std::memory_order_relaxed) / (double)n * 1e-6 : 0.0;
+        }
+
+        double MaxSeconds(){ return maxMicros.load(std::memory_order_relaxed) * 1e-6; }
+
+        // Upper edge of the bucket holding the given fraction of samples, never above the largest sample
+        double PercentileSeconds(double fraction){
+            uint64_t n = Samples();
+            if (n == 0) { return 0.0; }
+            uint64_t target = (uint64_t)std::ceil(fraction * n), seen = 0;
+            for (int b = 0; b < bucketCount; b++){
+                seen += counts[b].load(std::memory_order_relaxed);
+                if (seen >= target && seen > 0) { return std::min(MaxSeconds(), std::pow(2.0, (b + 1) / (double)bucketsPerDoubling) * 1e-6); }
+            }
+            return MaxSeconds();
+        }
+
+    private:
+        std::atomic<uint64_t> counts[bucketCount] = {};
+        std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> totalMicros{0};
+        std::atomic<uint64_t> maxMicros{0};
+};
+
+// Chunk pipeline latency per stage and throughput per event. Chunks stamp
+// their ChunkTimeline as they move along and report each finished stage here,
+// workers included, so everything is lock free.
+class PipelineTelemetry{
+    public:
+        LatencyHistogram stages[PipelineStage::Count];
+
+        PipelineTelemetry(){ start = Now(); }
+
+        static double Now(){
+            static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+        }
+
+        void Count(int event){ events[event].fetch_add(1, std::memory_order_relaxed); }
+
+        // Records the stage between two stamps once both have happened
+        void Record(int stage, double from, double to){
+            if (from > 0.0 && to >= from) { stages[stage].Add(to - from); }
+        }
+
+        uint64_t Events(int event){ return events[event].load(std::memory_order_relaxed); }
+
+        double Elapsed(){ return Now() - start; }
+
+        // Chunks per second since the telemetry was created
+        double Throughput(int event){
+            double elapsed = Elapsed();
+            return elapsed > 0.0 ? Events(event) / elapsed : 0.0;
+        }
+
+        // Format follows the extension, .json or anything else for CSV
+        bool Write(const std::string& path){
+            std::ofstream file(path);
+            if (!file){
+                std::cout << "ERROR::TELEMETRY::FILE_NOT_OPENED " << path << std::endl;
+                return false;
+            }
+            bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+            file << (json ? Json() : Csv());
+            return true;
+        }
+
+        std::string Csv(){
+            std::string out = "stage,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+            for (int s = 0; s < PipelineStage::Count; s++){
+                LatencyHistogram& h = stages[s];
+                out += std::string(pipelineStageNames[s]) + "," + std::to_string(h.Samples()) + "," + Ms(h.MeanSeconds()) + "," +
+                       Ms(h.PercentileSeconds(0.50)) + "," + Ms(h.PercentileSeconds(0.95)) + "," +
+                       Ms(h.PercentileSeconds(0.99)) + "," + Ms(h.MaxSeconds()) + "\n";
+            }
+            out += "\nevent,count,per_second\n";
+            for (int e = 0; e < PipelineEvent::Count; e++){
+                out += std::string(pipelineEventNames[e]) + "," + std::to_string(Events(e)) + "," + std::to_string(Throughput(e)) + "\n";
+            }
+            return out;
+        }
+
+        std::string Json(){
+            std::string out = "{\n  \"elapsed_s\": " + std::to_string(Elapsed()) + ",\n  \"stages\": {\n";
+            for (int s = 0; s < PipelineStage::Count; s++){
+                LatencyHistogram& h = stages[s];
+                out += std::string("    \"") + pipelineStageNames[s] + "\": { \"samples\": " + std::to_string(h.Samples()) +
+                       ", \"mean_ms\": " + Ms(h.MeanSeconds()) + ", \"p50_ms\": " + Ms(h.PercentileSeconds(0.50)) +
+                       ", \"p95_ms\": " + Ms(h.PercentileSeconds(0.95)) + ", \"p99_ms\": " + Ms(h.PercentileSeconds(0.99)) +
+                       ", \"max_ms\": " + Ms(h.MaxSeconds()) + " }" + (s + 1 < PipelineStage::Count ? ",\n" : "\n");
+            }
+            out += "  },\n  \"throughput\": {\n";
+            for (int e = 0; e < PipelineEvent::Count; e++){
+                out += std::string("    \"") + pipelineEventNames[e] + "\": { \"count\": " + std::to_string(Events(e)) +
+                       ", \"per_second\": " + std::to_string(Throughput(e)) + " }" + (e + 1 < PipelineEvent::Count ? ",\n" : "\n");
+            }
+            return out + "  }\n}\n";
+        }
+
+        // p50/p95/p99 of one stage in milliseconds, for logs and the title
+        std::string Summary(int stage){
+            LatencyHistogram& h = stages[stage];
+            return std::string(pipelineStageNames[stage]) + " " + Ms(h.PercentileSeconds(0.50)) + "/" +
+                   Ms(h.PercentileSeconds(0.95)) + "/" + Ms(h.PercentileSeconds(0.99)) + " ms";
+        }
+
+    private:
+        std::atomic<uint64_t> events[PipelineEvent::Count] = {};
+        double start;
+
+        static std::string Ms(double seconds){
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.3f", seconds * 1000.0);
+            return buffer;
+        }
+};
+
+#endif
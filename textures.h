@@ -0,0 +1,128 @@
+#ifndef TEXTURES_H
+#define TEXTURES_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+
+// main.cpp includes stb_image with its implementation first, including it again
+// here would pull the implementation in twice
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+#include "blockregistry.h"
+#include "workerpool.h"
+
+// Block textures as one GL_TEXTURE_2D_ARRAY, a layer per TextureLayers entry.
+// Images are decoded with stb_image on a worker so the render thread never
+// waits on disk or PNG decoding. Until they arrive a single white texel per
+// layer is bound, Upload swaps the real array in on the first frame after the
+// worker has finished and builds the mipmaps with glGenerateMipmap.
+//
+// Layer n is read from <directory>/<textureLayerNames[n]>.png. Missing files,
+// or files of the wrong size, get a generated pattern instead.
+class TextureArray{
+    public:
+        static const int layerSize = 16;
+
+        unsigned int ID = 0;
+
+        TextureArray(){
+            // Placeholder so sampling before the load finishes returns plain white
+            std::vector<unsigned char> white(TextureLayers::Count * 4, 255);
+            glGenTextures(1, &ID);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, TextureLayers::Count, 0, GL_RGBA, GL_UNSIGNED_BYTE, white.data());
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+
+        ~TextureArray(){
+            glDeleteTextures(1, &ID);
+        }
+
+        // The array has to outlive the job, WorkerPool finishes queued jobs when it is deleted
+        void StartLoading(WorkerPool* workers, std::string directory){
+            loadState = 1;
+            workers->Submit([this, directory]{ Load(directory); });
+        }
+
+        // Called on the render thread each frame, returns true once the real textures are bound
+        bool Upload(){
+            if (loadState != 2) { return loadState == 3; }
+
+            glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layerSize, layerSize, TextureLayers::Count, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            std::vector<unsigned char>().swap(pixels);
+            loadState = 3;
+            return true;
+        }
+
+        void Bind(int unit){
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+        }
+
+    private:
+        // 0 - Not started
+        // 1 - Decoding on a worker
+        // 2 - Decoded, waiting for Upload
+        // 3 - Uploaded
+        std::atomic<int> loadState{0};
+
+        std::vector<unsigned char> pixels;
+
+        void Load(const std::string& directory){
+            const int layerBytes = layerSize * layerSize * 4;
+            pixels.resize(layerBytes * TextureLayers::Count);
+
+            // Flip so row 0 is the bottom of the image, matching world space y
+            stbi_set_flip_vertically_on_load_thread(1);
+            for (int layer = 0; layer < TextureLayers::Count; layer++){
+                std::string path = directory + "/" + textureLayerNames[layer] + ".png";
+                unsigned char* out = pixels.data() + layer * layerBytes;
+
+                int width, height, channels;
+                unsigned char* image = stbi_load(path.c_str(), &width, &height, &channels, 4);
+                if (image != nullptr && width == layerSize && height == layerSize){
+                    std::memcpy(out, image, layerBytes);
+                } else {
+                    if (image == nullptr) { std::cout << "ERROR::TEXTURES::LOAD_FAILED " << path << std::endl; }
+                    else { std::cout << "ERROR::TEXTURES::SIZE_MISMATCH " << path << std::endl; }
+                    GeneratePattern(layer, out);
+                }
+                if (image != nullptr) { stbi_image_free(image); }
+            }
+            loadState = 2;
+        }
+
+        // Speckled flat colour so a missing texture is obvious but still readable
+        static void GeneratePattern(int layer, unsigned char* out){
+            static const unsigned char colours[TextureLayers::Count][3] = {
+                { 125, 125, 125 }, { 134, 96, 67 }, { 95, 159, 53 }, { 120, 110, 70 }, { 200, 230, 240 }, { 250, 220, 120 }
+            };
+            for (int i = 0; i < layerSize * layerSize; i++){
+                unsigned int hash = (unsigned int)(i * 2654435761u) ^ (unsigned int)(layer * 40503u);
+                int shade = (int)((hash >> 13) % 32) - 16;
+                for (int c = 0; c < 3; c++){
+                    int value = colours[layer][c] + shade;
+                    out[i * 4 + c] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+                }
+                out[i * 4 + 3] = 255;
+            }
+        }
+};
+
+#endif
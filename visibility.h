@@ -0,0 +1,127 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include <cmath>
+#include <vector>
+#include <functional>
+
+#include "chunk.h"
+#include "glm/glm.hpp"
+
+// Cave culling over chunk sections. Each section stores which of its faces
+// can see each other through open blocks (worked out by the mesher). Starting
+// from the camera's section a breadth first search walks into neighbouring
+// sections, only leaving a section through a face connected to the one it
+// came in by, and never heading back the way it has already travelled.
+// Sections the search never reaches are hidden behind solid ground.
+//
+// Chunks that are missing or not yet meshed are treated as open so that the
+// search is never stopped by terrain that has not loaded.
+class VisibilityGraph{
+    public:
+        std::function<Chunk*(int, int)> findChunk;
+
+        bool enabled = true;
+
+        // Sections reached and sections considered by the last Update
+        size_t sectionsVisible = 0, sectionsTotal = 0;
+
+        VisibilityGraph(int cXS, int cYS, int cZS){
+            chunkXSize = cXS; chunkYSize = cYS; chunkZSize = cZS;
+            sectionCount = (chunkYSize + Chunk::sectionSize - 1) / Chunk::sectionSize;
+        }
+
+        // Searches the square of columns within radius of (centreX, centreZ)
+        void Update(glm::vec3 camPos, int centreX, int centreZ, int radius){
+            originX = centreX - radius; originZ = centreZ - radius;
+            width = radius * 2 + 1;
+            visible.assign(width * width, 0);
+            sectionsTotal = (size_t)width * width * sectionCount;
+
+            if (!enabled){
+                for (size_t i = 0; i < visible.size(); i++) { visible[i] = (1u << sectionCount) - 1; }
+                sectionsVisible = sectionsTotal;
+                return;
+            }
+
+            queue.clear();
+            int camX = FloorDiv((int)std::floor(camPos.x), chunkXSize);
+            int camZ = FloorDiv((int)std::floor(camPos.z), chunkZSize);
+            int camY = (int)std::floor(camPos.y);
+
+            if (camY >= chunkYSize || camY < 0){
+                // Outside the world vertically, everything on the nearest layer is in view
+                bool above = camY >= chunkYSize;
+                int layer = above ? sectionCount - 1 : 0;
+                for (int z = 0; z < width; z++){
+                    for (int x = 0; x < width; x++){
+                        Push(Node{ originX + x, layer, originZ + z, (signed char)(above ? 1 : 4), (unsigned char)(1u << (above ? 4 : 1)) });
+                    }
+                }
+            } else {
+                Push(Node{ camX, camY / Chunk::sectionSize, camZ, -1, 0 });
+            }
+
+            for (size_t head = 0; head < queue.size(); head++){
+                Node node = queue[head];
+                Chunk* ch = findChunk(node.x, node.z);
+                unsigned long long connected = ch != nullptr ? ch->SectionVisibility(node.y) : ~0ull;
+
+                for (int d = 0; d < 6; d++){
+                    if (node.travelled & (1u << Opposite(d))) { continue; }
+                    if (node.from >= 0 && (connected & (1ull << (node.from * 6 + d))) == 0) { continue; }
+
+                    Node next = Node{ node.x + directions[d].x, node.y + directions[d].y, node.z + directions[d].z,
+                                      (signed char)Opposite(d), (unsigned char)(node.travelled | (1u << d)) };
+                    Push(next);
+                }
+            }
+
+            sectionsVisible = queue.size();
+        }
+
+        // Bit s is set when section s of the column was reached
+        unsigned int Visible(int xCoord, int zCoord){
+            int x = xCoord - originX, z = zCoord - originZ;
+            if (x < 0 || x >= width || z < 0 || z >= width) { return 0; }
+            return visible[x + width * z];
+        }
+
+    private:
+        struct Node{
+            int x, y, z;            // Chunk column and section
+            signed char from;       // Face the search entered by, -1 for the start
+            unsigned char travelled; // Directions taken so far
+        };
+
+        int chunkXSize, chunkYSize, chunkZSize;
+        int sectionCount;
+
+        int originX = 0, originZ = 0, width = 0;
+        std::vector<unsigned int> visible;
+        std::vector<Node> queue;
+
+        // Same order as the mesher's faces: +X, +Y, +Z, -X, -Y, -Z
+        const glm::ivec3 directions[6] = {
+            glm::ivec3(1, 0, 0), glm::ivec3(0, 1, 0), glm::ivec3(0, 0, 1),
+            glm::ivec3(-1, 0, 0), glm::ivec3(0, -1, 0), glm::ivec3(0, 0, -1)
+        };
+
+        static int Opposite(int face){ return (face + 3) % 6; }
+
+        static int FloorDiv(int a, int b){
+            return a >= 0 ? a / b : (a - b + 1) / b;
+        }
+
+        void Push(const Node& node){
+            int x = node.x - originX, z = node.z - originZ;
+            if (x < 0 || x >= width || z < 0 || z >= width || node.y < 0 || node.y >= sectionCount) { return; }
+
+            unsigned int& column = visible[x + width * z];
+            if (column & (1u << node.y)) { return; }
+            column |= 1u << node.y;
+            queue.push_back(node);
+        }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef VOXELSTORE_H
+#define VOXELSTORE_H
+
+#include <cstddef>
+
+#include "blockregistry.h"
+#include "memstats.h"
+
+// Block ids and packed light of one chunk. Both arrays are laid out x fastest,
+// then z, then y, and are only allocated once something is written, so a
+// chunk that has not been generated costs nothing.
+//
+// Light packs skylight in the high nibble and block light in the low one.
+class VoxelStore{
+    public:
+        VoxelStore(int cXS, int cYS, int cZS){
+            chunkXSize = cXS; chunkYSize = cYS; chunkZSize = cZS;
+        }
+
+        ~VoxelStore(){
+            if (blocks != nullptr){
+                delete[] blocks;
+                MemoryStats::Freed(MemoryTag::Voxels, BlockBytes());
+            }
+            if (light != nullptr){
+                delete[] light;
+                MemoryStats::Freed(MemoryTag::Light, LightBytes());
+            }
+        }
+
+        int Volume(){ return chunkXSize * chunkYSize * chunkZSize; }
+        int Index(int x, int y, int z){ return x + chunkXSize * chunkZSize * y + chunkZSize * z; }
+
+        // Inverse of Index
+        void Position(int index, int& x, int& y, int& z){
+            y = index / (chunkXSize * chunkZSize);
+            z = index % (chunkXSize * chunkZSize) / chunkZSize;
+            x = index % chunkZSize;
+        }
+
+        size_t BlockBytes(){ return (size_t)Volume() * sizeof(unsigned int); }
+        size_t LightBytes(){ return (size_t)Volume(); }
+
+        // Raw arrays for generation and meshing, nullptr until allocated
+        unsigned int* BlockData(){ return blocks; }
+        unsigned char* LightData(){ return light; }
+
+        void AllocateBlocks(){
+            if (blocks != nullptr) { return; }
+            blocks = new unsigned int[Volume()];
+            MemoryStats::Allocated(MemoryTag::Voxels, BlockBytes());
+        }
+
+        void AllocateLight(){
+            if (light != nullptr) { return; }
+            light = new unsigned char[Volume()];
+            MemoryStats::Allocated(MemoryTag::Light, LightBytes());
+        }
+
+        // Everything outside the chunk reads as stone, unallocated blocks as air
+        unsigned int GetBlock(unsigned int x, unsigned int y, unsigned int z){
+            if (x >= (unsigned int)chunkXSize || y >= (unsigned int)chunkYSize || z >= (unsigned int)chunkZSize) { return Blocks::Stone; }
+            if (blocks == nullptr) { return Blocks::Air; }
+            return blocks[Index(x, y, z)];
+        }
+
+        // False when the position is outside the chunk or nothing is allocated
+        bool SetBlock(unsigned int x, unsigned int y, unsigned int z, unsigned int val){
+            int index = Index(x, y, z);
+            if (blocks == nullptr || index < 0 || index >= Volume()) { return false; }
+            blocks[index] = val;
+            return true;
+        }
+
+        unsigned char GetLight(int x, int y, int z){
+            if (light == nullptr) { return 0; }
+            return light[Index(x, y, z)];
+        }
+
+        void SetSkyLight(int x, int y, int z, unsigned char level){
+            if (light == nullptr) { return; }
+            unsigned char& l = light[Index(x, y, z)];
+            l = (unsigned char)((level << 4) | (l & 15));
+        }
+
+        void SetBlockLight(int x, int y, int z, unsigned char level){
+            if (light == nullptr) { return; }
+            unsigned char& l = light[Index(x, y, z)];
+            l = (unsigned char)((l & 0xF0) | (level & 15));
+        }
+
+        // Hands the block array to the caller, who takes over its accounting
+        unsigned int* ReleaseBlocks(){
+            unsigned int* data = blocks;
+            blocks = nullptr;
+            return data;
+        }
+
+        // What is allocated right now
+        size_t Bytes(){
+            return (blocks != nullptr ? BlockBytes() : 0) + (light != nullptr ? LightBytes() : 0);
+        }
+
+    private:
+        int chunkXSize, chunkYSize, chunkZSize;
+
+        unsigned int* blocks = nullptr;
+        unsigned char* light = nullptr;
+};
+
+#endif
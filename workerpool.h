@@ -0,0 +1,97 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "memstats.h"
+
+// Fixed set of long lived worker threads running queued jobs. Each priority
+// has its own queue, a worker always takes the oldest job of the highest
+// priority waiting.
+class WorkerPool{
+    public:
+        enum Priority{
+            High,       // Work the player is waiting on, such as remeshing an edit
+            Normal,     // Chunks inside the view
+            Low,        // Speculative work, such as prefetching ahead of the camera
+            PriorityCount
+        };
+
+        WorkerPool(unsigned int threadCount){
+            if (threadCount == 0) { threadCount = 1; }
+            for (unsigned int i = 0; i < threadCount; i++) {
+                workers.push_back(std::thread(&WorkerPool::Run, this));
+            }
+        }
+
+        // Finishes every queued job before returning
+        ~WorkerPool(){
+            {
+                std::lock_guard<std::mutex> guard(jobLock);
+                stopping = true;
+            }
+            jobSignal.notify_all();
+            for (size_t i = 0; i < workers.size(); i++) { workers[i].join(); }
+        }
+
+        void Submit(std::function<void()> job, Priority priority = Normal){
+            {
+                std::lock_guard<std::mutex> guard(jobLock);
+                jobs[priority].push_back(std::move(job));
+            }
+            MemoryStats::Allocated(MemoryTag::JobQueues, sizeof(std::function<void()>));
+            jobSignal.notify_one();
+        }
+
+        size_t Pending(){
+            std::lock_guard<std::mutex> guard(jobLock);
+            size_t total = 0;
+            for (int p = 0; p < PriorityCount; p++) { total += jobs[p].size(); }
+            return total;
+        }
+
+        size_t Pending(Priority priority){
+            std::lock_guard<std::mutex> guard(jobLock);
+            return jobs[priority].size();
+        }
+
+        size_t ThreadCount(){ return workers.size(); }
+
+        static unsigned int DefaultThreadCount(){
+            unsigned int cores = std::thread::hardware_concurrency();
+            return cores > 1 ? cores - 1 : 1;
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque< std::function<void()> > jobs[PriorityCount];
+        std::mutex jobLock;
+        std::condition_variable jobSignal;
+        bool stopping = false;
+
+        void Run(){
+            while (true){
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(jobLock);
+                    int p = 0;
+                    jobSignal.wait(lock, [this, &p]{
+                        for (p = 0; p < PriorityCount; p++) { if (!jobs[p].empty()) { return true; } }
+                        return stopping;
+                    });
+                    if (p == PriorityCount) { return; }
+                    job = std::move(jobs[p].front());
+                    jobs[p].pop_front();
+                }
+                MemoryStats::Freed(MemoryTag::JobQueues, sizeof(std::function<void()>));
+                job();
+            }
+        }
+};
+
+#endif
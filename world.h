@@ -2,14 +2,36 @@
 #define WORLD_H
 
 #include "chunk.h"
-#include "shader.h"
-#include "camera.h"
+#include "chunkio.h"
+#include "workerpool.h"
+#include "lighting.h"
+#include "occlusion.h"
+#include "chunkcache.h"
+#include "telemetry.h"
+#include "remotechunks.h"
+#include "randomticks.h"
 
 #include <vector>
 #include <thread>
 #include <map>
+#include <set>
+#include <string>
+#include <iostream>
 #include <cmath>
+#include <algorithm>
 
+struct RaycastHit{
+    bool hit = false;
+    glm::ivec3 block = glm::ivec3(0);   // World block coordinates
+    glm::ivec3 local = glm::ivec3(0);   // Block coordinates inside chunk
+    glm::ivec3 normal = glm::ivec3(0);  // Normal of the face the ray entered through
+    float distance = 0.0f;
+    Chunk* chunk = nullptr;
+};
+
+// Chunks around a position, their streaming, edits and lighting. Needs no GL
+// context, WorldRenderer draws it, so servers, benchmarks and tools can tick a
+// World on their own.
 class World{
     public:
         std::map< std::pair<int, int>, Chunk*> chunkMap;
@@ -17,44 +39,315 @@ class World{
 
         static const int chunkXSize = 16, chunkYSize = 32, chunkZSize = 16;
 
+        RegionStore* store;
+        ChunkIO* io;
+        WorkerPool* workers;
+        LightEngine* light;
+        ChunkCache* cache;
+        PipelineTelemetry* telemetry;
+        RandomTicker* ticker;
+        // Set by ConnectToServer, chunks are then fetched from a chunk server
+        // and only lit and meshed here
+        RemoteChunkSource* remote = nullptr;
+
+        // Edits from the server waiting for their chunk to finish generating
+        struct ServerEdit{ int x, z; unsigned int index, block; };
+        std::vector<ServerEdit> deferredEdits;
+
+        std::vector<glm::ivec2> loadOrder;
+
+        glm::vec3 lastTickPosition = glm::vec3(0.0f);
+        glm::vec3 travel = glm::vec3(0.0f);
+        int prefetchX = 0, prefetchZ = 0;
+        bool prefetchActive = false;
+
         World(int rDist){
             renderDistance = rDist;
+            store = new RegionStore("World", chunkXSize * chunkYSize * chunkZSize);
+            io = new ChunkIO(store, chunkXSize * chunkYSize * chunkZSize);
+            workers = new WorkerPool(WorkerPool::DefaultThreadCount());
+
+            light = new LightEngine(chunkXSize, chunkYSize, chunkZSize);
+            light->findChunk = [this](int x, int z){ return FindChunk(x, z); };
+            light->onChanged = [this](Chunk* ch, glm::ivec3 local){ MarkDirtyAround(ch, local); };
+
+            cache = new ChunkCache();
+            cache->onEvict = [this](Chunk* ch){ Unload(ch); };
+
+            telemetry = new PipelineTelemetry();
+
+            ticker = new RandomTicker(chunkXSize, chunkYSize, chunkZSize, workers);
+            ticker->findChunk = [this](int x, int z){ return FindChunk(x, z); };
         }
 
-        void Draw(Shader& shader, Camera* cam){
-            int camXCoord = cam->position.x / chunkXSize;
-            int camZCoord = cam->position.z / chunkZSize;
+        // Queues every modified chunk and waits for the write queue to drain
+        ~World(){
+            if (remote != nullptr) { DropServer(); }
+            delete workers;
+
+            std::map< std::pair<int, int>, Chunk* >::iterator iter;
+            for (iter = chunkMap.begin(); iter != chunkMap.end(); iter++) {
+                Chunk* ch = iter->second;
+                while (ch->chunkState == 1 && !ch->blocksReady) { std::this_thread::yield(); }
+                Unload(ch);
+            }
+            chunkMap.clear();
+
+            delete cache;
+            delete ticker;
+            delete telemetry;
+            delete light;
+            delete io;
+            delete store;
+        }
 
+        // Jobs started per tick, so the cost of a tick does not depend on how
+        // much of the world is waiting to load
+        int generationsPerTick = 32;
+        int remeshesPerTick = 16;
+
+        // The camera's travel per tick, smoothed over recent ticks, is
+        // extrapolated prefetchTicks ahead (at most prefetchChunks away) and
+        // the band of columns around that point that is not yet in range is
+        // generated at low priority
+        bool prefetchEnabled = true;
+        int prefetchTicks = 40;
+        int prefetchChunks = 4;
+        int prefetchesPerTick = 16;
+        // Prefetching waits while this many low priority jobs are queued
+        size_t prefetchQueueLimit = 64;
+
+        // Totals since the world was created
+        size_t ticks = 0, generationsStarted = 0, remeshesScheduled = 0, prefetchesStarted = 0;
+
+        // Random block ticks for every loaded section with tickable blocks,
+        // skipped while connected to a server, which owns the world's state
+        bool randomTicksEnabled = true;
+        // Sections that had tickable blocks when last ticked, out of all
+        // sections of generated chunks, and the time spent ticking in total
+        size_t tickedSections = 0, generatedSections = 0;
+        double randomTickSeconds = 0.0;
+
+        // Columns in range and inside the view frustum when counted, and how
+        // many of those had not been generated yet, see CountReadiness
+        size_t columnsInView = 0, columnsNotReady = 0;
+
+        // Advances the simulation one fixed step: unloads chunks that are out of
+        // range, starts generation of missing ones, schedules remeshes and takes
+        // in the finished ones. Chunks
+        // are visited nearest first, so the budgets go to what is closest.
+        void Tick(glm::vec3 position){
+            int camXCoord = position.x / chunkXSize;
+            int camZCoord = position.z / chunkZSize;
+
+            if (ticks > 0) { travel = glm::mix(travel, position - lastTickPosition, 0.25f); }
+            lastTickPosition = position;
+            UpdatePrefetchCentre(position, camXCoord, camZCoord);
+
+            if (remote != nullptr) { ReceiveFromServer(); }
             RemoveUnloadedFromMap(camXCoord, camZCoord);
+            if (loadOrder.size() != (size_t)((renderDistance * 2 + 1) * (renderDistance * 2 + 1))) { BuildLoadOrder(); }
 
-            //glm::vec3 camDirection = glm::normalize(glm::vec3(cam->forward.x, 0, cam->forward.z));
+            int generations = 0, remeshes = 0;
+            for (size_t i = 0; i < loadOrder.size(); i++){
+                int x = camXCoord + loadOrder[i].x, z = camZCoord + loadOrder[i].y;
+                Chunk* ch = IndexChunks(x, z);
 
-            for (int z = camZCoord - renderDistance; z < camZCoord + renderDistance + 1; z++) {
-                for (int x = camXCoord - renderDistance; x < camXCoord + renderDistance + 1; x++) {
-                    //glm::vec3 toChunk = glm::normalize(glm::vec3(x - camXCoord, 0, z - camZCoord));
+                int lod = ChooseLod(std::max(std::abs(loadOrder[i].x), std::abs(loadOrder[i].y)), ch->lodLevel);
 
-                    //float dot = glm::dot(camDirection, toChunk);
-                    //float angle = std::acos(dot);
+                if (ch->remeshState == 2) { ch->ApplyRemesh(); }
+                if ((ch->chunkState == 2 || ch->chunkState == 3) && !ch->neighboursUpdated) { OnGenerated(ch); }
 
-                    //if (glm::degrees(angle) > (cam->fov)) {continue;}
+                if (ch->chunkState == 1){
+                    ch->generationCancelled = false;
+                    if (ch->blocksReady) { ScheduleFirstMesh(ch, WorkerPool::High); }
+                }
+                else if (ch->chunkState == 0 && generations < generationsPerTick){
+                    ScheduleGeneration(ch, lod, WorkerPool::Normal);
+                    generations++;
+                }
+                else if ((ch->chunkState == 2 || ch->chunkState == 3) && ch->remeshState == 0 && remeshes < remeshesPerTick &&
+                        (ch->dirtySections != 0 || lod != ch->lodLevel)){
+                    ScheduleRemesh(ch, lod);
+                    remeshes++;
+                }
+            }
 
-                    Chunk* ch = IndexChunks(x, z);
-                    
-                    if (ch->chunkState == 0){
-                        ch->StartAsyncGeneration();
-                    }
-                    else if (ch->chunkState == 2){
-                        ch->SetupMesh();
-                    } 
-                    else if (ch->chunkState == 3){
-                        glm::mat4 model = glm::mat4(1.0f);
-                        model = glm::translate(model, glm::vec3(ch->xCoord * chunkXSize,0,ch->zCoord * chunkZSize));
-                        shader.setMat4("model", model);
-
-                        ch->Draw();
-                    }
+            if (randomTicksEnabled && remote == nullptr) { RandomTicks(); }
+
+            ticks++;
+            generationsStarted += generations;
+            remeshesScheduled += remeshes;
+
+            if (prefetchActive) { Prefetch(camXCoord, camZCoord); }
+        }
+
+        // Gathers the sections worth ticking in map order, so each chunk's
+        // sections are visited together, then applies what the ticks changed
+        // through the usual edit path
+        void RandomTicks(){
+            double start = PipelineTelemetry::Now();
+            std::vector<TickSection> sections;
+            generatedSections = 0;
+            std::map< std::pair<int, int>, Chunk* >::iterator iter;
+            for (iter = chunkMap.begin(); iter != chunkMap.end(); iter++){
+                Chunk* ch = iter->second;
+                if (ch->chunkState != 2 && ch->chunkState != 3) { continue; }
+                generatedSections += ch->SectionCount();
+                for (int s = 0; s < ch->SectionCount(); s++){
+                    if (ch->TickableBlocks(s) > 0) { sections.push_back(TickSection{ ch, s }); }
+                }
+            }
+            tickedSections = sections.size();
+
+            std::vector<BlockChange> changes;
+            ticker->Tick(sections, changes);
+            for (size_t i = 0; i < changes.size(); i++){
+                BlockChange& change = changes[i];
+                if (change.chunk->GetAt(change.local.x, change.local.y, change.local.z) == change.block) { continue; }
+                ChangeBlock(change.chunk, change.local, change.block);
+                ticker->changesMade++;
+            }
+            randomTickSeconds += PipelineTelemetry::Now() - start;
+        }
+
+        // Counts how many columns in view have not been generated, so pop in at
+        // the edge of the world can be measured. Generated chunks are uploaded
+        // by the renderer's next frame, so they count as ready.
+        void CountReadiness(const glm::mat4& viewProjection, glm::vec3 position){
+            int camXCoord = position.x / chunkXSize;
+            int camZCoord = position.z / chunkZSize;
+            for (int z = camZCoord - renderDistance; z <= camZCoord + renderDistance; z++){
+                for (int x = camXCoord - renderDistance; x <= camXCoord + renderDistance; x++){
+                    glm::vec3 min = glm::vec3(x * chunkXSize, 0, z * chunkZSize);
+                    if (!OcclusionCuller::BoxInFrustum(viewProjection, min, min + glm::vec3(chunkXSize, chunkYSize, chunkZSize))) { continue; }
+
+                    columnsInView++;
+                    Chunk* ch = FindChunk(x, z);
+                    if (ch == nullptr || ch->chunkState < 2 || ch->chunkState == 4) { columnsNotReady++; }
                 }
-            }    
+            }
+        }
+
+        void ScheduleGeneration(Chunk* ch, int lod, WorkerPool::Priority priority){
+            if (!ch->ClaimGeneration()) { return; }
+            ch->targetLod = lod;
+            ch->timeline.queued = PipelineTelemetry::Now();
+            telemetry->Record(PipelineStage::Scheduling, ch->timeline.requested, ch->timeline.queued);
+            // Chunks edited here are saved here, so those are always loaded locally
+            if (remote != nullptr && !ch->storedOnDisk && !ch->blocksReceived) { remote->Request(ch->xCoord, ch->zCoord); return; }
+            workers->Submit([ch]{ ch->Generate(); }, priority);
+        }
+
+        // Meshes a chunk whose blocks have just been generated, with the borders
+        // of whichever neighbours have generated by now
+        void ScheduleFirstMesh(Chunk* ch, WorkerPool::Priority priority){
+            ch->blocksReady = false;
+            unsigned int* apron = BuildApron(ch);
+            workers->Submit([ch, apron]{ ch->MeshGenerated(apron); }, priority);
+        }
+
+        bool ConnectToServer(const std::string& address){
+            remote = new RemoteChunkSource(chunkXSize * chunkYSize * chunkZSize);
+            if (!remote->Connect(address)) { delete remote; remote = nullptr; }
+            return remote != nullptr;
+        }
+
+        // Takes in the chunks and edits the server has sent since the last
+        // tick, the chunks still get lit and meshed on the workers. Chunks that
+        // left range while waiting go back to ungenerated so they can be
+        // unloaded.
+        void ReceiveFromServer(){
+            std::vector<ServerEdit> retry;
+            retry.swap(deferredEdits);
+            for (size_t i = 0; i < retry.size(); i++) { ApplyServerEdit(retry[i]); }
+
+            bool connected = remote->Poll([this](int x, int z, const unsigned int* blocks){
+                Chunk* ch = FindChunk(x, z);
+                if (ch == nullptr || ch->chunkState != 1 || ch->blocksReceived) { return; }
+                if (ch->generationCancelled.exchange(false)) { ch->chunkState = 0; return; }
+                ch->ReceiveBlocks(blocks);
+                workers->Submit([ch]{ ch->Generate(); }, WorkerPool::Normal);
+            }, [this](int x, int z, unsigned int index, unsigned int block){
+                ApplyServerEdit(ServerEdit{ x, z, index, block });
+            });
+            if (!connected){
+                std::cout << "ERROR::WORLD::SERVER_LOST, generating chunks locally" << std::endl;
+                DropServer();
+            }
+        }
+
+        // Another client's edit. Chunks being lit and meshed take it once
+        // they are done, and a copy kept in the cache would miss it, so that
+        // is dropped and asked for again when the camera comes back.
+        void ApplyServerEdit(const ServerEdit& edit){
+            Chunk* ch = FindChunk(edit.x, edit.z);
+            if (ch == nullptr){
+                Chunk* cached = cache->Take(edit.x, edit.z);
+                if (cached != nullptr) { Unload(cached); }
+                return;
+            }
+            if (ch->chunkState == 1 && ch->blocksReceived) { deferredEdits.push_back(edit); return; }
+            if (ch->chunkState != 2 && ch->chunkState != 3) { return; }
+            ChangeBlock(ch, ch->BlockPosition(edit.index), edit.block);
+        }
+
+        // Chunks still waiting on the server go back to ungenerated, Tick then
+        // generates them here
+        void DropServer(){
+            std::set< std::pair<int, int> >::iterator it;
+            for (it = remote->outstanding.begin(); it != remote->outstanding.end(); it++){
+                Chunk* ch = FindChunk(it->first, it->second);
+                if (ch != nullptr && ch->chunkState == 1 && !ch->blocksReceived){
+                    ch->generationCancelled = false;
+                    ch->chunkState = 0;
+                }
+            }
+            deferredEdits.clear();
+            delete remote;
+            remote = nullptr;
+        }
+
+        // Offsets of every column within renderDistance, nearest first
+        void BuildLoadOrder(){
+            loadOrder.clear();
+            for (int z = -renderDistance; z <= renderDistance; z++){
+                for (int x = -renderDistance; x <= renderDistance; x++) { loadOrder.push_back(glm::ivec2(x, z)); }
+            }
+            std::stable_sort(loadOrder.begin(), loadOrder.end(), [](glm::ivec2 a, glm::ivec2 b){
+                return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y;
+            });
+        }
+
+        void UpdatePrefetchCentre(glm::vec3 position, int camX, int camZ){
+            float reachX = (float)(prefetchChunks * chunkXSize), reachZ = (float)(prefetchChunks * chunkZSize);
+            glm::vec3 ahead = travel * (float)prefetchTicks;
+            ahead.x = std::min(reachX, std::max(-reachX, ahead.x));
+            ahead.z = std::min(reachZ, std::max(-reachZ, ahead.z));
+
+            prefetchX = (int)((position.x + ahead.x) / chunkXSize);
+            prefetchZ = (int)((position.z + ahead.z) / chunkZSize);
+            prefetchActive = prefetchEnabled && (prefetchX != camX || prefetchZ != camZ);
+        }
+
+        // Generates columns in range of the predicted position that are not yet
+        // in range of the camera, nearest the predicted position first
+        void Prefetch(int camX, int camZ){
+            int started = 0;
+            for (size_t i = 0; i < loadOrder.size() && started < prefetchesPerTick; i++){
+                int x = prefetchX + loadOrder[i].x, z = prefetchZ + loadOrder[i].y;
+                int distance = std::max(std::abs(x - camX), std::abs(z - camZ));
+                if (distance <= renderDistance) { continue; }
+                if (workers->Pending(WorkerPool::Low) >= prefetchQueueLimit) { break; }
+
+                Chunk* ch = IndexChunks(x, z);
+                if (ch->chunkState == 1) { ch->generationCancelled = false; }
+                if (ch->chunkState == 1 && ch->blocksReady) { ScheduleFirstMesh(ch, WorkerPool::Low); }
+                if (ch->chunkState != 0) { continue; }
+                ScheduleGeneration(ch, ChooseLod(distance, ch->lodLevel), WorkerPool::Low);
+                started++;
+            }
+            prefetchesStarted += started;
         }
 
         void RemoveUnloadedFromMap(int camX, int camZ){
@@ -67,6 +360,11 @@ class World{
 
                 if (std::abs(camX - ch->xCoord) > renderDistance + 1 || 
                         std::abs(camZ - ch->zCoord) > renderDistance + 1){
+                    // Kept while it is part of the prefetched band
+                    if (prefetchActive && std::abs(prefetchX - ch->xCoord) <= renderDistance + 1 &&
+                            std::abs(prefetchZ - ch->zCoord) <= renderDistance + 1) { continue; }
+                    // Still queued, skip the work and unload once the job hands it back
+                    if (ch->chunkState == 1) { ch->generationCancelled = true; }
                     store.push_back(iter->first);
                 }
             }
@@ -75,47 +373,241 @@ class World{
                 Chunk* ch = chunkMap[store.at(i)];
                 if (ch->CanDeleteObject()){
                     chunkMap.erase(store.at(i));
-                    delete ch;
+                    // Generated chunks are kept in case the camera comes back
+                    if (ch->chunkState == 2 || ch->chunkState == 3) { cache->Insert(ch); }
+                    else { Unload(ch); }
                 }
             }
         }
 
+        void Unload(Chunk* ch){
+            if (remote != nullptr && ch->blocksReceived) { remote->Forget(ch->xCoord, ch->zCoord); }
+            if (ch->modified){
+                unsigned int* data = ch->ReleaseData();
+                if (data != nullptr) { io->Enqueue(ch->xCoord, ch->zCoord, data); }
+            }
+            delete ch;
+        }
+
         Chunk* IndexChunks(int xCoord, int zCoord){
             std::pair<int, int> pair (xCoord, zCoord);
 
             Chunk* ch = chunkMap[pair];
             if (ch != nullptr){
                 return ch;
+            }
+
+            ch = cache->Take(xCoord, zCoord);
+            if (ch != nullptr){
+                // Neighbours loaded while it was cached were meshed without it
+                ch->neighboursUpdated = false;
+                chunkMap[pair] = ch;
+                return ch;
             } else {
                 ch = new Chunk(xCoord, zCoord, chunkXSize, chunkYSize, chunkZSize);
+                ch->io = io;
+                ch->telemetry = telemetry;
+                ch->timeline.requested = PipelineTelemetry::Now();
+                telemetry->Count(PipelineEvent::Requested);
+                ch->storedOnDisk = io->Contains(xCoord, zCoord);
                 chunkMap[pair] = ch;
                 return chunkMap[pair];
             }
         }
 
-        /*
-        void DestroyBlock(Camera* cam, float range){
-            for (float i = 0; i < range; i += 0.1){
-                glm::vec3 blockFloat = cam->position + (float)i * (glm::normalize(cam->forward));
-                glm::vec3 blockInt = glm::vec3((int)std::floor(blockFloat.x) % chunkXSize, 
-                                               (int)std::floor(blockFloat.y),
-                                               (int)std::floor(blockFloat.z) % chunkZSize);
-                glm::vec2 chunkIndex = glm::vec2(std::floor(blockFloat.x / (float)chunkXSize), std::floor(blockFloat.z / (float)chunkZSize));
-                
-                Chunk* ch = IndexChunks(chunkIndex.x, chunkIndex.y);
+        // Returns the loaded chunk at the given coordinates without creating one
+        Chunk* FindChunk(int xCoord, int zCoord){
+            std::map< std::pair<int, int>, Chunk* >::iterator iter = chunkMap.find(std::pair<int, int>(xCoord, zCoord));
+            if (iter == chunkMap.end()) { return nullptr; }
+            return iter->second;
+        }
+
+        static int FloorDiv(int a, int b){
+            return a >= 0 ? a / b : (a - b + 1) / b;
+        }
+
+        // Amanatides-Woo voxel traversal. Visits every block the ray passes
+        // through in order, so thin corners are never skipped, and only looks up
+        // a chunk again when the ray crosses into a new one. Ungenerated chunks
+        // are treated as air.
+        RaycastHit Raycast(glm::vec3 origin, glm::vec3 direction, float range){
+            RaycastHit result;
+            if (glm::length(direction) == 0.0f) { return result; }
+            glm::vec3 dir = glm::normalize(direction);
+
+            glm::ivec3 voxel = glm::ivec3(std::floor(origin.x), std::floor(origin.y), std::floor(origin.z));
+            glm::ivec3 step, normal(0);
+            glm::vec3 tMax, tDelta;
+            for (int i = 0; i < 3; i++) {
+                step[i] = dir[i] > 0 ? 1 : (dir[i] < 0 ? -1 : 0);
+                tDelta[i] = step[i] != 0 ? std::abs(1.0f / dir[i]) : INFINITY;
+                tMax[i] = step[i] != 0 ? ((voxel[i] + (step[i] > 0 ? 1 : 0)) - origin[i]) / dir[i] : INFINITY;
+            }
+
+            Chunk* ch = nullptr;
+            int chX = 0, chZ = 0;
+            bool chValid = false;
+            float t = 0.0f;
+
+            while (t <= range){
+                if (voxel.y >= 0 && voxel.y < chunkYSize){
+                    int cx = FloorDiv(voxel.x, chunkXSize), cz = FloorDiv(voxel.z, chunkZSize);
+                    if (!chValid || cx != chX || cz != chZ){
+                        ch = FindChunk(cx, cz);
+                        if (ch != nullptr && ch->chunkState < 2) { ch = nullptr; }
+                        chX = cx; chZ = cz; chValid = true;
+                    }
+
+                    if (ch != nullptr){
+                        glm::ivec3 local = glm::ivec3(voxel.x - cx * chunkXSize, voxel.y, voxel.z - cz * chunkZSize);
+                        if (BlockRegistry::Solid(ch->GetAt(local.x, local.y, local.z))){
+                            result.hit = true;
+                            result.block = voxel;
+                            result.local = local;
+                            result.normal = normal;
+                            result.distance = t;
+                            result.chunk = ch;
+                            return result;
+                        }
+                    }
+                }
+                else if ((voxel.y < 0 && step.y <= 0) || (voxel.y >= chunkYSize && step.y >= 0)){
+                    break; // Left the world vertically and is not coming back
+                }
+
+                int axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+                voxel[axis] += step[axis];
+                t = tMax[axis];
+                tMax[axis] += tDelta[axis];
+                normal = glm::ivec3(0);
+                normal[axis] = -step[axis];
+            }
+            return result;
+        }
+
+        void DestroyBlock(glm::vec3 origin, glm::vec3 direction, float range){
+            RaycastHit hit = Raycast(origin, direction, range);
+            if (hit.hit){
+                SetBlock(hit.chunk, hit.local, Blocks::Air);
+            }
+        }
+
+        // Edits a block, relights around it and marks the sections that need
+        // remeshing. The remesh itself is scheduled from Tick. With a server
+        // the edit is also sent to it with the next tick's batch.
+        void SetBlock(Chunk* ch, glm::ivec3 local, unsigned int val){
+            if (remote != nullptr) { remote->QueueEdit(ch->xCoord, ch->zCoord, ch->BlockIndex(local), val); }
+            ChangeBlock(ch, local, val);
+        }
+
+        void ChangeBlock(Chunk* ch, glm::ivec3 local, unsigned int val){
+            unsigned int old = ch->GetAt(local.x, local.y, local.z);
+            ch->SetAt(local.x, local.y, local.z, val);
+            MarkDirtyAround(ch, local);
+
+            glm::ivec3 pos = glm::ivec3(ch->xCoord * chunkXSize + local.x, local.y, ch->zCoord * chunkZSize + local.z);
+            light->OnBlockChanged(pos, old, val);
+        }
+
+        // Marks the section holding a block dirty, and the section above or
+        // below when the block sits on a slab boundary, in this chunk and in
+        // the neighbouring chunks whose faces and corner shading can touch it
+        void MarkDirtyAround(Chunk* ch, glm::ivec3 local){
+            int section = local.y / Chunk::sectionSize;
+            int other = section;
+            if (local.y % Chunk::sectionSize == 0) { other = section - 1; }
+            if (local.y % Chunk::sectionSize == Chunk::sectionSize - 1) { other = section + 1; }
+            ch->MarkDirty(section);
+            ch->MarkDirty(other);
+
+            for (int dz = -1; dz <= 1; dz++){
+                for (int dx = -1; dx <= 1; dx++){
+                    if (dx == 0 && dz == 0) { continue; }
+                    if ((dx == -1 && local.x != 0) || (dx == 1 && local.x != chunkXSize - 1)) { continue; }
+                    if ((dz == -1 && local.z != 0) || (dz == 1 && local.z != chunkZSize - 1)) { continue; }
+
+                    Chunk* neighbour = FindChunk(ch->xCoord + dx, ch->zCoord + dz);
+                    if (neighbour != nullptr) { neighbour->MarkDirty(section); neighbour->MarkDirty(other); }
+                }
+            }
+        }
+
+        void ScheduleRemesh(Chunk* ch, int lod){
+            unsigned int mask = ch->dirtySections.exchange(0);
+            if (lod != ch->lodLevel || lod > 0) { mask = ch->AllSections(); }
+            unsigned int* apron = BuildApron(ch);
+
+            // Edits are waited on, level of detail changes can wait behind generation
+            WorkerPool::Priority priority = lod == ch->lodLevel ? WorkerPool::High : WorkerPool::Normal;
+            ch->remeshState = 1;
+            workers->Submit([ch, apron, mask, lod]{ ch->Remesh(apron, mask, lod); }, priority);
+        }
+
+        // Chunk distance at which each coarser level of detail starts
+        int lodDistances[Chunk::maxLod] = { 6, 10, 14 };
+        // Chunks a level boundary has to be crossed by before switching, so
+        // hovering on a boundary does not keep remeshing
+        int lodHysteresis = 1;
+
+        int LodFor(int distance){
+            int level = 0;
+            while (level < Chunk::maxLod && distance >= lodDistances[level]) { level++; }
+            return level;
+        }
+
+        int ChooseLod(int distance, int current){
+            int desired = LodFor(distance);
+            if (desired > current && LodFor(distance - lodHysteresis) <= current) { return current; }
+            if (desired < current && LodFor(distance + lodHysteresis) >= current) { return current; }
+            return desired;
+        }
+
+        // Snapshot of a chunk and the border blocks of its generated neighbours,
+        // taken on the main thread so the worker never reads live voxel data
+        unsigned int* BuildApron(Chunk* ch){
+            unsigned int* apron = new unsigned int[ch->ApronSize()];
+            MemoryStats::Allocated(MemoryTag::JobQueues, ch->ApronSize() * sizeof(unsigned int));
+            ch->FillApron(apron);
+
+            ch->apronNeighbours = 0;
+            for (int dz = -1; dz <= 1; dz++){
+                for (int dx = -1; dx <= 1; dx++){
+                    if (dx == 0 && dz == 0) { continue; }
+                    Chunk* neighbour = FindChunk(ch->xCoord + dx, ch->zCoord + dz);
+                    if (IsGenerated(neighbour)){
+                        ch->CopyApronFrom(neighbour, dx, dz, apron);
+                        ch->apronNeighbours |= NeighbourBit(dx, dz);
+                    }
+                }
+            }
+            return apron;
+        }
+
+        static unsigned int NeighbourBit(int dx, int dz){ return 1u << ((dx + 1) + (dz + 1) * 3); }
+
+        static bool IsGenerated(Chunk* ch){
+            if (ch == nullptr) { return false; }
+            unsigned int state = ch->chunkState;
+            return state == 2 || state == 3;
+        }
 
-                unsigned int block = ch->GetAt(blockInt.x, blockInt.y, blockInt.z);
+        // Called once a chunk has generated. Its neighbours that were meshed
+        // while it was missing have stone and darkness along that border, so
+        // they are remeshed, and so is the chunk itself if neighbours have
+        // generated since its apron was taken.
+        void OnGenerated(Chunk* ch){
+            ch->neighboursUpdated = true;
+            for (int dz = -1; dz <= 1; dz++){
+                for (int dx = -1; dx <= 1; dx++){
+                    if (dx == 0 && dz == 0) { continue; }
+                    Chunk* neighbour = FindChunk(ch->xCoord + dx, ch->zCoord + dz);
+                    if (!IsGenerated(neighbour)) { continue; }
 
-                if (block == 1){
-                    ch->SetAt(blockInt.x, blockInt.y, blockInt.z, 0);
-                    ch->RemoveMesh();
-                    ch->GenerateMeshData();
-                    ch->SetupMesh();
-                    break;
+                    if ((ch->apronNeighbours & NeighbourBit(dx, dz)) == 0) { ch->dirtySections |= ch->AllSections(); }
+                    if ((neighbour->apronNeighbours & NeighbourBit(-dx, -dz)) == 0) { neighbour->dirtySections |= neighbour->AllSections(); }
                 }
             }
         }
-        */
 };
 
 #endif
\ No newline at end of file